@@ -0,0 +1,350 @@
+/*
+ * Copyright (c) 2019 Travis Geiselbrecht
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <bench.h>
+
+#include <atomic.h>
+#include <boot_params.h>
+#include <heap.h>
+#include <irqsoff.h>
+#include <kcounter.h>
+#include <klog.h>
+#include <ktrace.h>
+#include <printf.h>
+#include <profile.h>
+#include <smp.h>
+#include <spinlock.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <task.h>
+#include <time.h>
+#include <hw/pic.h>
+#include <hw/vga.h>
+#include <x86/x86.h>
+
+// each benchmark runs its operation iters times. the runner doubles iters until
+// a run takes at least BENCH_MIN_NS, then reports the time per operation.
+// results are printed to the console as lines of the form
+//   bench: name=<name> iters=<n> ns_per_op=<ns>
+// after the suite is finished, so printing doesn't disturb the measurements.
+
+#define BENCH_MIN_NS        (50 * 1000 * 1000ULL)
+#define BENCH_MAX_ITERS     (1U << 24)
+
+// write a value to the qemu isa-debug-exit device, qemu exits with (val << 1) | 1
+#define QEMU_DEBUG_EXIT_PORT 0xf4
+
+struct bench {
+    const char *name;
+    void (*func)(uint32_t iters, uintptr_t arg);
+    uintptr_t arg;
+    uint32_t ops_per_iter;
+};
+
+struct bench_result {
+    uint32_t iters;
+    uint32_t ns_per_op;
+};
+
+// keep the compiler from discarding work whose results are never looked at
+#define bench_barrier() __asm__ volatile("" ::: "memory")
+
+static uint8_t bench_src[4096];
+static uint8_t bench_dst[4096];
+
+// context switch: ping pong with a second task, two switches per iteration
+static volatile bool pingpong_done;
+static task_t pingpong_task;
+static uint8_t pingpong_stack[1024] __ALIGNED(4);
+
+static void pingpong_entry(void *arg) {
+    while (!pingpong_done) {
+        task_reschedule();
+    }
+}
+
+static void bench_context_switch(uint32_t iters, uintptr_t arg) {
+    pingpong_done = false;
+    task_create(&pingpong_task, "pingpong", &pingpong_entry, NULL, (uintptr_t)pingpong_stack, sizeof(pingpong_stack));
+    task_start_on(&pingpong_task, smp_cpu_num());
+
+    for (uint32_t i = 0; i < iters; i++) {
+        task_reschedule();
+    }
+
+    // let the other task see the flag and exit
+    pingpong_done = true;
+    while (pingpong_task.state != DEAD) {
+        task_reschedule();
+    }
+}
+
+// task create/exit: start a task with an empty body and switch to it, it exits
+// and comes straight back here
+static task_t empty_task;
+static uint8_t empty_stack[1024] __ALIGNED(4);
+
+static void empty_entry(void *arg) {
+}
+
+static void bench_task_create(uint32_t iters, uintptr_t arg) {
+    for (uint32_t i = 0; i < iters; i++) {
+        task_create(&empty_task, "empty", &empty_entry, NULL, (uintptr_t)empty_stack, sizeof(empty_stack));
+        task_start_on(&empty_task, smp_cpu_num());
+        while (empty_task.state != DEAD) {
+            task_reschedule();
+        }
+    }
+}
+
+// smp scaling: split a fixed amount of cpu bound work across arg tasks, one per
+// cpu while there are enough cpus. ns_per_op drops with the worker count for as
+// long as the cpus run them in parallel.
+static task_t smp_workers[SMP_MAX_CPUS];
+static uint8_t smp_worker_stacks[SMP_MAX_CPUS][1024] __ALIGNED(4);
+static uint32_t smp_worker_iters[SMP_MAX_CPUS];
+static uint32_t smp_workers_done;
+static volatile uint32_t smp_worker_sink;
+static wait_queue_t smp_workers_wait = WAIT_QUEUE_INITIAL_VALUE(smp_workers_wait);
+
+static void smp_worker_entry(void *arg) {
+    uint32_t x = 2463534242U;
+
+    for (uint32_t i = *(uint32_t *)arg; i > 0; i--) {
+        for (int j = 0; j < 64; j++) {
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+        }
+    }
+    smp_worker_sink = x;
+
+    // stay in the critical section through the exit, so by the time the
+    // count is seen complete the task is off its stack and can be reused
+    enter_critical_section();
+    smp_workers_done++;
+    wait_queue_wake_one(&smp_workers_wait);
+    task_exit();
+}
+
+static void bench_smp_scaling(uint32_t iters, uintptr_t arg) {
+    uint32_t workers = arg;
+
+    smp_workers_done = 0;
+    for (uint32_t i = 0; i < workers; i++) {
+        smp_worker_iters[i] = iters / workers + (i < iters % workers);
+        task_create(&smp_workers[i], "smp_worker", &smp_worker_entry, &smp_worker_iters[i],
+                    (uintptr_t)smp_worker_stacks[i], sizeof(smp_worker_stacks[i]));
+        task_start_on(&smp_workers[i], (smp_cpu_num() + i) % smp_cpu_count);
+    }
+
+    enter_critical_section();
+    while (smp_workers_done != workers) {
+        wait_queue_block(&smp_workers_wait);
+    }
+    exit_critical_section();
+}
+
+// a mix of sizes, freed out of order to exercise coalescing
+static void bench_malloc_free(uint32_t iters, uintptr_t arg) {
+    static const size_t sizes[] = { 16, 48, 100, 256, 24, 512, 64, 8 };
+    void *ptrs[countof(sizes)];
+
+    for (uint32_t i = 0; i < iters; i++) {
+        for (size_t j = 0; j < countof(sizes); j++) {
+            ptrs[j] = malloc(sizes[j]);
+        }
+        for (size_t j = 1; j < countof(sizes); j += 2) {
+            free(ptrs[j]);
+        }
+        for (size_t j = 0; j < countof(sizes); j += 2) {
+            free(ptrs[j]);
+        }
+    }
+}
+
+static void bench_memcpy(uint32_t iters, uintptr_t len) {
+    for (uint32_t i = 0; i < iters; i++) {
+        memcpy(bench_dst, bench_src, len);
+        bench_barrier();
+    }
+}
+
+static void bench_memset(uint32_t iters, uintptr_t len) {
+    for (uint32_t i = 0; i < iters; i++) {
+        memset(bench_dst, i, len);
+        bench_barrier();
+    }
+}
+
+static volatile uint32_t bench_atomic;
+
+static void bench_atomic_fetch_add(uint32_t iters, uintptr_t arg) {
+    for (uint32_t i = 0; i < iters; i++) {
+        atomic_fetch_add(&bench_atomic, 1);
+    }
+}
+
+// uncontended, so this is the cost of the lock and unlock themselves
+static void bench_spin_lock(uint32_t iters, uintptr_t arg) {
+    static spin_lock_t lock = SPIN_LOCK_INITIAL_VALUE;
+
+    for (uint32_t i = 0; i < iters; i++) {
+        spin_lock(&lock);
+        spin_unlock(&lock);
+    }
+}
+
+static void bench_spin_lock_irqsave(uint32_t iters, uintptr_t arg) {
+    static spin_lock_t lock = SPIN_LOCK_INITIAL_VALUE;
+    spin_lock_saved_state_t state;
+
+    for (uint32_t i = 0; i < iters; i++) {
+        spin_lock_irqsave(&lock, &state);
+        spin_unlock_irqrestore(&lock, state);
+    }
+}
+
+static void bench_critical_section(uint32_t iters, uintptr_t arg) {
+    for (uint32_t i = 0; i < iters; i++) {
+        enter_critical_section();
+        exit_critical_section();
+    }
+}
+
+static void bench_snprintf(uint32_t iters, uintptr_t arg) {
+    char buf[128];
+
+    for (uint32_t i = 0; i < iters; i++) {
+        snprintf(buf, sizeof(buf), "%d %lu %s %#lx %p %c", -(int)i, i, "bench", i, buf, 'x');
+        bench_barrier();
+    }
+}
+
+// a full line of text, scrolling the screen every time
+static void bench_vga_line(uint32_t iters, uintptr_t arg) {
+    for (uint32_t i = 0; i < iters; i++) {
+        for (int c = 0; c < 79; c++) {
+            vga_console_putchar('a' + c % 26);
+        }
+        vga_console_putchar('\r');
+        vga_console_putchar('\n');
+    }
+}
+
+static const struct bench benches[] = {
+    { "context_switch", &bench_context_switch, 0, 2 },
+    { "task_create_exit", &bench_task_create, 0, 1 },
+    { "malloc_free_x8", &bench_malloc_free, 0, 1 },
+    { "memcpy_16", &bench_memcpy, 16, 1 },
+    { "memcpy_256", &bench_memcpy, 256, 1 },
+    { "memcpy_4096", &bench_memcpy, 4096, 1 },
+    { "memset_16", &bench_memset, 16, 1 },
+    { "memset_256", &bench_memset, 256, 1 },
+    { "memset_4096", &bench_memset, 4096, 1 },
+    { "atomic_fetch_add", &bench_atomic_fetch_add, 0, 1 },
+    { "spin_lock", &bench_spin_lock, 0, 1 },
+    { "spin_lock_irqsave", &bench_spin_lock_irqsave, 0, 1 },
+    { "critical_section", &bench_critical_section, 0, 1 },
+    { "smp_scaling_1", &bench_smp_scaling, 1, 1 },
+    { "smp_scaling_2", &bench_smp_scaling, 2, 1 },
+    { "smp_scaling_4", &bench_smp_scaling, 4, 1 },
+    { "snprintf", &bench_snprintf, 0, 1 },
+    { "vga_line", &bench_vga_line, 0, 1 },
+};
+
+static struct bench_result run_one(const struct bench *b) {
+    uint32_t iters = 1;
+    uint64_t elapsed;
+
+    for (;;) {
+        uint64_t start = current_time_ns();
+        b->func(iters, b->arg);
+        elapsed = current_time_ns() - start;
+
+        if (elapsed >= BENCH_MIN_NS || iters >= BENCH_MAX_ITERS) {
+            break;
+        }
+        iters *= 2;
+    }
+
+    return (struct bench_result) {
+        .iters = iters,
+        .ns_per_op = elapsed / ((uint64_t)iters * b->ops_per_iter),
+    };
+}
+
+static void qemu_exit(uint8_t val) {
+    outp(QEMU_DEBUG_EXIT_PORT, val);
+}
+
+void bench_run(void) {
+    struct bench_result results[countof(benches)];
+
+    // get any pending output out of the way so the log task stays quiet
+    klog_flush();
+
+    // profile.hz=<rate> samples the whole suite
+    uint32_t profile_hz = boot_param_uint("profile.hz", 0);
+    if (profile_hz && profile_start(profile_hz) < 0) {
+        printf("profile: failed to start at %lu hz\n", profile_hz);
+        profile_hz = 0;
+    }
+
+    for (size_t i = 0; i < countof(benches); i++) {
+        results[i] = run_one(&benches[i]);
+    }
+
+    if (profile_hz) {
+        profile_stop();
+    }
+
+    printf("bench: begin count=%zu\n", countof(benches));
+    for (size_t i = 0; i < countof(benches); i++) {
+        printf("bench: name=%s iters=%lu ns_per_op=%lu\n", benches[i].name,
+               results[i].iters, results[i].ns_per_op);
+    }
+    printf("bench: end\n");
+
+    kcounter_dump();
+    pic_dump_stats();
+    if (IRQSOFF_TRACE) {
+        irqsoff_dump();
+    }
+    if (KTRACE) {
+        ktrace_dump();
+    }
+    if (profile_hz) {
+        profile_dump();
+    }
+
+    klog_flush();
+    qemu_exit(0);
+
+    // not running under qemu, just stop here
+    for (;;) {
+        task_reschedule();
+        x86_hlt();
+    }
+}
@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2019 Travis Geiselbrecht
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <boot_params.h>
+
+#include <ctype.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// the command line, with each space replaced by a nul so the words are strings
+static char cmdline[BOOT_PARAMS_CMDLINE_LEN];
+static size_t cmdline_len;
+
+void boot_params_init(const struct boot_params *params) {
+    if (!params || params->magic != BOOT_PARAMS_MAGIC ||
+            params->version != BOOT_PARAMS_VERSION || params->size != BOOT_PARAMS_SIZE) {
+        return;
+    }
+
+    size_t i;
+    for (i = 0; i < sizeof(cmdline) - 1 && params->cmdline[i]; i++) {
+        char c = params->cmdline[i];
+        cmdline[i] = isspace(c) ? 0 : c;
+    }
+    cmdline[i] = 0;
+    cmdline_len = i;
+}
+
+// if word is key=value, return value
+static const char *match_key(const char *word, const char *key) {
+    while (*key && *word == *key) {
+        word++;
+        key++;
+    }
+    return (*key == 0 && *word == '=') ? word + 1 : NULL;
+}
+
+const char *boot_param_get(const char *key) {
+    // the last one wins, so settings appended to a default line override it
+    const char *val = NULL;
+    for (size_t i = 0; i < cmdline_len; i++) {
+        if (cmdline[i] && (i == 0 || cmdline[i - 1] == 0)) {
+            const char *v = match_key(&cmdline[i], key);
+            if (v) {
+                val = v;
+            }
+        }
+    }
+    return val;
+}
+
+static bool parse_uint(const char *s, uint32_t *out) {
+    uint32_t base = 10;
+    uint32_t val = 0;
+
+    if (s[0] == '0' && (s[1] == 'x' || s[1] == 'X')) {
+        base = 16;
+        s += 2;
+    }
+    if (!isxdigit(*s)) {
+        return false;
+    }
+
+    for (; *s; s++) {
+        uint32_t digit;
+        if (isdigit(*s)) {
+            digit = *s - '0';
+        } else if (base == 16 && isxdigit(*s)) {
+            digit = (*s | 0x20) - 'a' + 10;
+        } else {
+            break;
+        }
+        // a value that doesn't fit is rejected rather than wrapped
+        if (val > (UINT32_MAX - digit) / base) {
+            return false;
+        }
+        val = val * base + digit;
+    }
+
+    uint32_t mult = 1;
+    switch (*s) {
+        case 'k': case 'K': mult = 1024; s++; break;
+        case 'm': case 'M': mult = 1024 * 1024; s++; break;
+    }
+    if (*s || val > UINT32_MAX / mult) {
+        return false;
+    }
+    val *= mult;
+
+    *out = val;
+    return true;
+}
+
+uint32_t boot_param_uint(const char *key, uint32_t def) {
+    const char *s = boot_param_get(key);
+    uint32_t val;
+
+    if (!s) {
+        return def;
+    }
+    if (!parse_uint(s, &val)) {
+        printf("boot param %s: bad number '%s'\n", key, s);
+        return def;
+    }
+    return val;
+}
+
+void boot_params_dump(void) {
+    printf("boot params:");
+    for (size_t i = 0; i < cmdline_len; i++) {
+        if (cmdline[i] && (i == 0 || cmdline[i - 1] == 0)) {
+            printf(" %s", &cmdline[i]);
+        }
+    }
+    printf("\n");
+}
@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2019 Travis Geiselbrecht
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <boottime.h>
+
+#include <boot_image.h>
+#include <compiler.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <time.h>
+#include <hw/pit.h>
+
+#define MAX_PHASES      24
+
+// the bios tick count is at 0x46c in the bios data area. it stops once the
+// bootloader disables irqs for the switch to protected mode, so at kernel entry
+// it still holds the time of the handoff. read it with a plain load, since the
+// compiler objects to dereferencing a constant address this low.
+static uint32_t read_bios_ticks(void) {
+    uint32_t ticks;
+    __asm__ volatile("movl 0x46c, %0" : "=r" (ticks));
+    return ticks;
+}
+
+// bios ticks are 65536 PIT clocks
+#define BIOS_TICK_US    54925
+
+struct boot_phase {
+    const char *name;
+    bool timed;
+    uint64_t ns;
+};
+
+static struct boot_phase phases[MAX_PHASES];
+static int phase_count;
+
+static uint32_t ticks_start;
+static uint32_t ticks_loaded;
+static uint32_t ticks_entry;
+
+void boottime_init(uint32_t bios_ticks_start, uint32_t bios_ticks_loaded) {
+    ticks_start = bios_ticks_start;
+    ticks_loaded = bios_ticks_loaded;
+    ticks_entry = read_bios_ticks();
+}
+
+void boottime_mark(const char *name) {
+    if (phase_count == MAX_PHASES) {
+        return;
+    }
+
+    struct boot_phase *p = &phases[phase_count++];
+    p->name = name;
+    p->timed = pit_is_running();
+    p->ns = p->timed ? current_time_ns() : 0;
+}
+
+static void print_ms(const char *name, uint64_t ns, uint64_t at_ns) {
+    uint32_t us = ns / 1000;
+    uint32_t at_us = at_ns / 1000;
+    printf("\t%-20s %6lu.%03lu ms  (at %lu.%03lu)\n", name, us / 1000, us % 1000,
+           at_us / 1000, at_us % 1000);
+}
+
+void boottime_dump(void) {
+    printf("boot timeline:\n");
+
+    // the bios ticks wrap at midnight, in which case these come out nonsense
+    if (ticks_start && ticks_loaded >= ticks_start && ticks_entry >= ticks_loaded) {
+        printf("\t%-20s %6lu ms\n", "bootloader load", (ticks_loaded - ticks_start) * BIOS_TICK_US / 1000);
+        printf("\t%-20s %6lu ms\n", "bootloader handoff", (ticks_entry - ticks_loaded) * BIOS_TICK_US / 1000);
+    } else {
+        printf("\tno bootloader timing\n");
+    }
+
+    // filled in by the decompressor stub, measured with the PIT
+    const struct boot_image_info *info = &boot_image_info;
+    if (info->compressed_size) {
+        uint32_t us = (uint64_t)info->decompress_clocks * 1000000 / PIT_FREQ;
+        printf("\t%-20s %6lu.%03lu ms  (%lu -> %lu bytes)\n", "kernel decompress",
+               us / 1000, us % 1000, info->compressed_size, info->uncompressed_size);
+    }
+
+    uint64_t last = 0;
+    for (int i = 0; i < phase_count; i++) {
+        const struct boot_phase *p = &phases[i];
+        if (!p->timed) {
+            printf("\t%-20s      -     (before the PIT was running)\n", p->name);
+            continue;
+        }
+        print_ms(p->name, p->ns - last, p->ns);
+        last = p->ns;
+    }
+}
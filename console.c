@@ -22,12 +22,42 @@
  */
 #include <console.h>
 
+#include <kcounter.h>
+#include <klog.h>
+#include <spsc_ring.h>
+#include <stdint.h>
+#include <task.h>
+#include <hw/uart.h>
 #include <hw/vga.h>
 
-// TODO implement input queue
+// console input is run through a simple line discipline as it arrives from the
+// input drivers. characters are echoed and edited in the line buffer, and
+// completed lines are moved to the input queue for readers.
+
+#define INPUT_QUEUE_SIZE    256     // must be a power of 2
+#define INPUT_LINE_MAX      128
+
+static char input_queue_buf[INPUT_QUEUE_SIZE];
+static struct spsc_ring input_queue = SPSC_RING_INITIAL_VALUE(input_queue_buf);
+static wait_queue_t input_wait = WAIT_QUEUE_INITIAL_VALUE(input_wait);
+
+KCOUNTER(console_bytes, "console.bytes_out");
+KCOUNTER(console_input_bytes, "console.bytes_in");
+KCOUNTER(console_input_lines_dropped, "console.lines_dropped");
+
+static char input_line[INPUT_LINE_MAX];
+static size_t input_line_len;
+
+// escape sequences from special keys or a serial terminal are swallowed
+static enum {
+    ESC_NONE,
+    ESC_START,      // saw ESC
+    ESC_SEQ,        // saw ESC [ or ESC O, waiting for the final byte
+} input_esc;
 
 void console_init() {
     vga_console_init(true);
+    uart_init();
 }
 
 int console_write(const char *str, size_t len, bool crlf) {
@@ -36,13 +66,109 @@ int console_write(const char *str, size_t len, bool crlf) {
         char c = *str++;
         if (crlf && c == '\n') {
             vga_console_putchar('\r');
+            uart_putchar('\r');
         }
         vga_console_putchar(c);
+        uart_putchar(c);
     }
+    kcounter_add(console_bytes, i);
 
     return i;
 }
 
+static void console_echo(const char *str, size_t len) {
+    klog_write(str, len);
+}
+
+// move the finished line into the input queue. readers expect whole lines, so
+// a line that doesn't fit is dropped entirely rather than cut short.
+static void console_commit_line(void) {
+    if (spsc_ring_space(&input_queue) < input_line_len) {
+        kcounter_add(console_input_lines_dropped, 1);
+        input_line_len = 0;
+        return;
+    }
+
+    spsc_ring_enqueue(&input_queue, input_line, input_line_len);
+    input_line_len = 0;
+
+    wait_queue_wake_all(&input_wait);
+}
+
+// called with interrupts disabled
 void console_input(char c) {
-    console_write(&c, 1, true);
+    kcounter_add(console_input_bytes, 1);
+
+    switch (input_esc) {
+        case ESC_START:
+            input_esc = (c == '[' || c == 'O') ? ESC_SEQ : ESC_NONE;
+            return;
+        case ESC_SEQ:
+            if (c >= 0x40 && c <= 0x7e) {
+                input_esc = ESC_NONE;
+            }
+            return;
+        default:
+            break;
+    }
+
+    switch (c) {
+        case 0x1b:
+            input_esc = ESC_START;
+            break;
+        case '\r':
+        case '\n':
+            input_line[input_line_len++] = '\n';
+            console_echo("\n", 1);
+            console_commit_line();
+            break;
+        case '\b':
+        case 0x7f: // DEL, sent by most terminals for backspace
+            if (input_line_len > 0) {
+                input_line_len--;
+                console_echo("\b \b", 3);
+            }
+            break;
+        case 0x15: // ^U, kill the line
+            while (input_line_len > 0) {
+                input_line_len--;
+                console_echo("\b \b", 3);
+            }
+            break;
+        default:
+            // leave room for the trailing newline
+            if (input_line_len < INPUT_LINE_MAX - 1 && (c == '\t' || (c >= ' ' && c < 0x7f))) {
+                input_line[input_line_len++] = c;
+                console_echo(&c, 1);
+            }
+            break;
+    }
+}
+
+int console_read(char *buf, size_t len) {
+    size_t i = 0;
+
+    if (len == 0) {
+        return 0;
+    }
+
+    // the critical section serializes readers and closes the race with the wakeup
+    enter_critical_section();
+
+    while (spsc_ring_is_empty(&input_queue)) {
+        wait_queue_block(&input_wait);
+    }
+
+    // hand back at most one line
+    char c;
+    while (i < len && spsc_ring_get(&input_queue, &c)) {
+        buf[i++] = c;
+        if (c == '\n') {
+            break;
+        }
+    }
+
+    exit_critical_section();
+
+    return i;
 }
@@ -23,12 +23,15 @@
 #include "debug.h"
 
 #include <ctype.h>
+#include <klog.h>
 #include <printf.h>
 #include <stdlib.h>
 #include <sys/types.h>
 #include <x86/x86.h>
 
 void _panic(void *caller, const char *fmt, ...) {
+    klog_panic();
+
     printf("panic (caller %p): ", caller);
 
     va_list ap;
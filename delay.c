@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2019 Travis Geiselbrecht
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <delay.h>
+
+#include <stdio.h>
+#include <hw/pit.h>
+
+// assume a fast machine until calibrated, so early delays err on the long side
+uint32_t delay_loops_per_us = 1000 << 16;
+
+// time a run of delay_loop() in PIT counts. the counter is running in mode 2,
+// counting down from pit_get_countdown() and reloading, so at most one wrap is handled.
+static uint32_t delay_time_loops(uint32_t loops) {
+    uint16_t start = pit_read_count();
+    delay_loop(loops);
+    uint16_t end = pit_read_count();
+
+    if (end <= start) {
+        return start - end;
+    } else {
+        return start + (pit_get_countdown() - end);
+    }
+}
+
+void delay_calibrate(void) {
+    uint32_t loops = 256;
+    uint32_t ticks;
+
+    // double the loop count until it takes a good chunk of a PIT period,
+    // but not so long that it could wrap more than once
+    for (;;) {
+        ticks = delay_time_loops(loops);
+        if (ticks >= pit_get_countdown() / 4u || loops >= 0x40000000) {
+            break;
+        }
+        loops *= 2;
+    }
+
+    if (ticks == 0) {
+        ticks = 1;
+    }
+
+    // loops per us = loops / (ticks / PIT_FREQ * 1000000)
+    delay_loops_per_us = (((uint64_t)loops << 16) * PIT_FREQ) / ((uint64_t)ticks * 1000000);
+    if (delay_loops_per_us == 0) {
+        delay_loops_per_us = 1;
+    }
+
+    printf("delay calibrated: %lu.%02lu loops per us\n", delay_loops_per_us >> 16,
+           ((delay_loops_per_us & 0xffff) * 100) >> 16);
+}
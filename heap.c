@@ -22,29 +22,72 @@
  */
 #include <heap.h>
 
+#include <boot_params.h>
+#include <kcounter.h>
+#include <ktrace.h>
 #include <miniheap.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <task.h>
 #include <trace.h>
 
 #define LOCAL_TRACE 0
 #define HEAP_TRACE 0
 
 // heap wrapper routines
+//
+// the miniheap has no locking of its own, so run it inside a critical section
+// to keep tasks preempted at irq exit from corrupting it.
 
 static uint32_t default_heap[16384/sizeof(uint32_t)];
 
-void heap_init(void) {
+extern char _end[];
+
+KCOUNTER(heap_allocs, "heap.alloc");
+KCOUNTER(heap_alloc_fails, "heap.alloc_fail");
+KCOUNTER(heap_frees, "heap.free");
+
+static void heap_count_alloc(void *ptr) {
+    kcounter_add(heap_allocs, 1);
+    if (!ptr) {
+        kcounter_add(heap_alloc_fails, 1);
+    }
+}
+
+void heap_init(uintptr_t mem_top) {
+    // a heap.size boot param bigger than the default moves the heap to the
+    // memory just past the kernel. the default heap is static, so it can't shrink.
+    size_t size = boot_param_uint("heap.size", sizeof(default_heap));
+    if (size > sizeof(default_heap)) {
+        uintptr_t base = ROUNDUP((uintptr_t)_end, 4096);
+        if (mem_top > base && size <= mem_top - base) {
+            miniheap_init((void *)base, size);
+            return;
+        }
+        printf("heap: heap.size %zu does not fit below %#lx, using the default\n", size, mem_top);
+    } else if (size < sizeof(default_heap)) {
+        printf("heap: heap.size %zu is below the default %zu, ignored\n", size, sizeof(default_heap));
+    }
+
     miniheap_init(default_heap, sizeof(default_heap));
 }
 
 void heap_trim(void) {
+    enter_critical_section();
     miniheap_trim();
+    exit_critical_section();
 }
 
 void *malloc(size_t size) {
     LTRACEF("size %zd\n", size);
 
+    KTRACE_BEGIN(malloc, size, 0);
+    enter_critical_section();
     void *ptr = miniheap_alloc(size, 0);
+    exit_critical_section();
+    heap_count_alloc(ptr);
+    KTRACE_END(malloc, ptr, 0);
     if (HEAP_TRACE) {
         printf("caller %p malloc %zu -> %p\n", __GET_CALLER(), size, ptr);
     }
@@ -54,7 +97,10 @@ void *malloc(size_t size) {
 void *memalign(size_t boundary, size_t size) {
     LTRACEF("boundary %zu, size %zd\n", boundary, size);
 
+    enter_critical_section();
     void *ptr = miniheap_alloc(size, boundary);
+    exit_critical_section();
+    heap_count_alloc(ptr);
     if (HEAP_TRACE) {
         printf("caller %p memalign %zu, %zu -> %p\n", __GET_CALLER(), boundary, size, ptr);
     }
@@ -66,7 +112,10 @@ void *calloc(size_t count, size_t size) {
 
     size_t realsize = count * size;
 
+    enter_critical_section();
     void *ptr = miniheap_alloc(realsize, 0);
+    exit_critical_section();
+    heap_count_alloc(ptr);
     if (likely(ptr)) {
         memset(ptr, 0, realsize);
     }
@@ -80,7 +129,9 @@ void *calloc(size_t count, size_t size) {
 void *realloc(void *ptr, size_t size) {
     LTRACEF("ptr %p, size %zd\n", ptr, size);
 
+    enter_critical_section();
     void *ptr2 = miniheap_realloc(ptr, size);
+    exit_critical_section();
     if (HEAP_TRACE) {
         printf("caller %p realloc %p, %zu -> %p\n", __GET_CALLER(), ptr, size, ptr2);
     }
@@ -93,7 +144,12 @@ void free(void *ptr) {
         printf("caller %p free %p\n", __GET_CALLER(), ptr);
     }
 
+    KTRACE_BEGIN(free, ptr, 0);
+    enter_critical_section();
     miniheap_free(ptr);
+    exit_critical_section();
+    kcounter_add(heap_frees, 1);
+    KTRACE_END(free, ptr, 0);
 }
 
 void heap_dump(void) {
@@ -0,0 +1,234 @@
+/*
+ * Copyright (c) 2019 Travis Geiselbrecht
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+// host native benchmarks for the portable parts of the kernel: miniheap,
+// printf, string, ctype and list. the kernel sources are compiled against the
+// kernel headers and have every symbol prefixed with k_ so they can't collide
+// with the host libc this file is built against.
+//
+// usage: hostbench [iteration scale]
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define countof(a) (sizeof(a) / sizeof((a)[0]))
+
+// the kernel side
+void *k_miniheap_alloc(size_t size, unsigned int alignment);
+void *k_miniheap_realloc(void *ptr, size_t size);
+void k_miniheap_free(void *ptr);
+void k_miniheap_init(void *ptr, size_t len);
+
+int k_snprintf(char *str, size_t len, const char *fmt, ...);
+void *k_memcpy(void *dest, const void *src, size_t count);
+void *k_memset(void *dest, int c, size_t count);
+size_t k_strlen(const char *s);
+int k_isalnum(int c);
+int k_isspace(int c);
+
+unsigned long k_list_bench(unsigned long iters);
+
+// shims for what the kernel sources expect from the rest of the kernel
+int k_klog_vprintf(const char *fmt, va_list ap) {
+    return vprintf(fmt, ap);
+}
+
+#define HEAP_SIZE       (1024 * 1024)
+#define HEAP_SLOTS      256
+
+static unsigned long scale = 1;
+
+// results are fed through here so the work can't be optimized away
+static volatile unsigned long sink;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void report(const char *name, unsigned long ops, uint64_t ns) {
+    printf("hostbench: name=%s ops=%lu ns_per_op=%.2f\n", name, ops, (double)ns / ops);
+}
+
+// small xorshift so runs are repeatable and independent of the host rand()
+static uint32_t rng_state = 0x12345678;
+
+static uint32_t rng(void) {
+    uint32_t x = rng_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return rng_state = x;
+}
+
+// mostly small sizes with the occasional large one, like the kernel sees
+static size_t random_size(void) {
+    uint32_t r = rng();
+    if ((r & 0xf) == 0) {
+        return 256 + (r >> 8) % 2048;
+    }
+    return 1 + (r >> 8) % 128;
+}
+
+// a random mix of alloc, free and realloc over a fixed set of slots
+static void bench_miniheap_mix(void) {
+    static void *slots[HEAP_SLOTS];
+    void *arena = malloc(HEAP_SIZE);
+    unsigned long ops = 2000000 * scale;
+
+    k_miniheap_init(arena, HEAP_SIZE);
+    memset(slots, 0, sizeof(slots));
+
+    uint64_t start = now_ns();
+    for (unsigned long i = 0; i < ops; i++) {
+        uint32_t r = rng();
+        void **slot = &slots[r % HEAP_SLOTS];
+
+        if (!*slot) {
+            *slot = k_miniheap_alloc(random_size(), 0);
+        } else if (r & 0x100) {
+            k_miniheap_free(*slot);
+            *slot = NULL;
+        } else {
+            void *p = k_miniheap_realloc(*slot, random_size());
+            if (p) {
+                *slot = p;
+            }
+        }
+    }
+    report("miniheap_mix", ops, now_ns() - start);
+
+    free(arena);
+}
+
+// lifo alloc/free of a single size, the fast path
+static void bench_miniheap_lifo(void) {
+    void *arena = malloc(HEAP_SIZE);
+    unsigned long ops = 4000000 * scale;
+
+    k_miniheap_init(arena, HEAP_SIZE);
+
+    uint64_t start = now_ns();
+    for (unsigned long i = 0; i < ops; i++) {
+        void *p = k_miniheap_alloc(64, 0);
+        k_miniheap_free(p);
+    }
+    report("miniheap_lifo_64", ops, now_ns() - start);
+
+    free(arena);
+}
+
+static void bench_printf(void) {
+    char buf[128];
+    unsigned long ops = 1000000 * scale;
+
+    uint64_t start = now_ns();
+    for (unsigned long i = 0; i < ops; i++) {
+        sink += k_snprintf(buf, sizeof(buf), "%d %u %s %#x %p %c", -(int)i, (unsigned)i, "bench", (unsigned)i, buf, 'x');
+    }
+    report("k_snprintf", ops, now_ns() - start);
+
+    // the host libc doing the same work, for scale
+    start = now_ns();
+    for (unsigned long i = 0; i < ops; i++) {
+        sink += snprintf(buf, sizeof(buf), "%d %u %s %#x %p %c", -(int)i, (unsigned)i, "bench", (unsigned)i, buf, 'x');
+    }
+    report("libc_snprintf", ops, now_ns() - start);
+}
+
+static void bench_string(void) {
+    static char src[4096], dst[4096];
+    static const size_t sizes[] = { 16, 256, 4096 };
+    char name[32];
+
+    for (size_t s = 0; s < countof(sizes); s++) {
+        unsigned long ops = (64 * 1024 * 1024 / sizes[s]) * scale;
+
+        uint64_t start = now_ns();
+        for (unsigned long i = 0; i < ops; i++) {
+            k_memcpy(dst, src, sizes[s]);
+            sink += dst[i % sizes[s]];
+        }
+        snprintf(name, sizeof(name), "k_memcpy_%zu", sizes[s]);
+        report(name, ops, now_ns() - start);
+
+        start = now_ns();
+        for (unsigned long i = 0; i < ops; i++) {
+            k_memset(dst, i, sizes[s]);
+            sink += dst[i % sizes[s]];
+        }
+        snprintf(name, sizeof(name), "k_memset_%zu", sizes[s]);
+        report(name, ops, now_ns() - start);
+    }
+
+    memset(src, 'a', 64);
+    src[64] = 0;
+    unsigned long ops = 4000000 * scale;
+    uint64_t start = now_ns();
+    for (unsigned long i = 0; i < ops; i++) {
+        sink += k_strlen(src);
+    }
+    report("k_strlen_64", ops, now_ns() - start);
+}
+
+static void bench_ctype(void) {
+    unsigned long ops = 200000 * scale;
+
+    uint64_t start = now_ns();
+    for (unsigned long i = 0; i < ops; i++) {
+        for (int c = 0; c < 256; c++) {
+            sink += k_isalnum(c) + k_isspace(c);
+        }
+    }
+    report("k_ctype_256", ops, now_ns() - start);
+}
+
+static void bench_list(void) {
+    unsigned long ops = 200000 * scale;
+
+    uint64_t start = now_ns();
+    sink += k_list_bench(ops);
+    report("list_fill_drain_64", ops, now_ns() - start);
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1) {
+        scale = strtoul(argv[1], NULL, 0);
+        if (scale == 0) {
+            fprintf(stderr, "usage: %s [iteration scale]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    bench_miniheap_mix();
+    bench_miniheap_lifo();
+    bench_printf();
+    bench_string();
+    bench_ctype();
+    bench_list();
+
+    return 0;
+}
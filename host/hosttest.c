@@ -0,0 +1,329 @@
+// host native tests for the portable parts of the kernel, built the same way
+// as hostbench: the kernel sources are compiled against the kernel headers and
+// have every symbol prefixed with k_. header only kernel code is included
+// directly, the kernel include dir is searched after the host's. exits nonzero
+// on the first mismatch.
+//
+// usage: hosttest [iteration scale]
+#include <pthread.h>
+#include <sched.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <spsc_ring.h>
+
+// the kernel side
+void *k_miniheap_alloc(size_t size, unsigned int alignment);
+void *k_miniheap_realloc(void *ptr, size_t size);
+void k_miniheap_free(void *ptr);
+void k_miniheap_init(void *ptr, size_t len);
+
+// shims for what the kernel sources expect from the rest of the kernel
+int k_klog_vprintf(const char *fmt, va_list ap) {
+    return vprintf(fmt, ap);
+}
+
+#define HEAP_SIZE       (256 * 1024)
+#define HEAP_SLOTS      256
+
+static unsigned long scale = 1;
+static int failures;
+
+#define FAIL(...) do { \
+    fprintf(stderr, "hosttest: FAIL %s: ", __func__); \
+    fprintf(stderr, __VA_ARGS__); \
+    fprintf(stderr, "\n"); \
+    failures++; \
+} while (0)
+
+// small xorshift so a failing run can be repeated
+static uint32_t rng_state = 0x12345678;
+
+static uint32_t rng_next(uint32_t *state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+static uint32_t rng(void) {
+    return rng_next(&rng_state);
+}
+
+// mostly small sizes with the occasional large one, like the kernel sees
+static size_t random_size(void) {
+    uint32_t r = rng();
+    if ((r & 0xf) == 0) {
+        return 256 + (r >> 8) % 4096;
+    }
+    return 1 + (r >> 8) % 128;
+}
+
+// what the heap should be holding in each slot. every block is filled with a
+// pattern derived from its tag so a stomped or moved block shows up.
+struct shadow {
+    uint8_t *ptr;
+    size_t size;
+    uint32_t tag;
+};
+
+static uint8_t pattern(uint32_t tag, size_t i) {
+    return (uint8_t)(tag + i * 31 + (i >> 8));
+}
+
+static void fill(struct shadow *s) {
+    for (size_t i = 0; i < s->size; i++) {
+        s->ptr[i] = pattern(s->tag, i);
+    }
+}
+
+static bool check_contents(const struct shadow *s, size_t len, unsigned long op) {
+    for (size_t i = 0; i < len; i++) {
+        if (s->ptr[i] != pattern(s->tag, i)) {
+            FAIL("op %lu: block %p size %zu byte %zu is %#x, expected %#x", op,
+                 s->ptr, s->size, i, s->ptr[i], pattern(s->tag, i));
+            return false;
+        }
+    }
+    return true;
+}
+
+static int compare_shadow(const void *a, const void *b) {
+    const struct shadow *sa = a, *sb = b;
+    return (sa->ptr > sb->ptr) - (sa->ptr < sb->ptr);
+}
+
+// every live block is inside the arena, intact and disjoint from its neighbours
+static bool check_all(const struct shadow *slots, const uint8_t *arena, unsigned long op) {
+    static struct shadow sorted[HEAP_SLOTS];
+    size_t count = 0;
+
+    for (size_t i = 0; i < HEAP_SLOTS; i++) {
+        if (!slots[i].ptr) {
+            continue;
+        }
+        if (slots[i].ptr < arena || slots[i].ptr + slots[i].size > arena + HEAP_SIZE) {
+            FAIL("op %lu: block %p size %zu is outside the arena", op, slots[i].ptr, slots[i].size);
+            return false;
+        }
+        if (!check_contents(&slots[i], slots[i].size, op)) {
+            return false;
+        }
+        sorted[count++] = slots[i];
+    }
+
+    qsort(sorted, count, sizeof(sorted[0]), compare_shadow);
+    for (size_t i = 1; i < count; i++) {
+        if (sorted[i - 1].ptr + sorted[i - 1].size > sorted[i].ptr) {
+            FAIL("op %lu: block %p size %zu overlaps block %p", op,
+                 sorted[i - 1].ptr, sorted[i - 1].size, sorted[i].ptr);
+            return false;
+        }
+    }
+    return true;
+}
+
+// a random mix of alloc, aligned alloc, free and realloc checked against a
+// shadow copy of what every slot should hold
+static void test_miniheap(void) {
+    static struct shadow slots[HEAP_SLOTS];
+    static const unsigned int alignments[] = { 0, 0, 0, 16, 32, 64, 256, 4096 };
+    uint8_t *arena = malloc(HEAP_SIZE);
+    unsigned long ops = 200000 * scale;
+    uint32_t next_tag = 1;
+
+    k_miniheap_init(arena, HEAP_SIZE);
+    memset(slots, 0, sizeof(slots));
+
+    for (unsigned long op = 0; op < ops && !failures; op++) {
+        uint32_t r = rng();
+        struct shadow *s = &slots[r % HEAP_SLOTS];
+
+        if (!s->ptr) {
+            unsigned int alignment = alignments[(r >> 8) % 8];
+            size_t size = random_size();
+            uint8_t *p = k_miniheap_alloc(size, alignment);
+            if (!p) {
+                continue;
+            }
+            if (alignment && ((uintptr_t)p & (alignment - 1))) {
+                FAIL("op %lu: alloc of %zu aligned to %u returned %p", op, size, alignment, p);
+                break;
+            }
+            s->ptr = p;
+            s->size = size;
+            s->tag = next_tag++;
+            fill(s);
+        } else if (r & 0x100) {
+            if (!check_contents(s, s->size, op)) {
+                break;
+            }
+            k_miniheap_free(s->ptr);
+            s->ptr = NULL;
+        } else {
+            size_t size = random_size();
+            uint8_t *p = k_miniheap_realloc(s->ptr, size);
+            if (!p) {
+                // the old block is untouched when realloc fails
+                continue;
+            }
+
+            // the old contents up to the smaller of the two sizes come along
+            struct shadow moved = { p, s->size < size ? s->size : size, s->tag };
+            if (!check_contents(&moved, moved.size, op)) {
+                break;
+            }
+            s->ptr = p;
+            s->size = size;
+            s->tag = next_tag++;
+            fill(s);
+        }
+
+        if ((op & 0xff) == 0 && !check_all(slots, arena, op)) {
+            break;
+        }
+    }
+
+    if (!failures) {
+        check_all(slots, arena, ops);
+    }
+
+    free(arena);
+    printf("hosttest: miniheap %lu ops %s\n", ops, failures ? "FAILED" : "ok");
+}
+
+// one producer and one consumer thread push a numbered stream through a small
+// ring in random batch sizes, some bigger than the ring. the counters start
+// just short of 2^32 so they wrap early in the run. the consumer checks that
+// every element arrives exactly once and in order.
+#define RING_COUNT      64
+#define RING_MAX_BATCH  (RING_COUNT * 2)
+
+struct ring_item {
+    uint32_t seq;
+    uint32_t check;     // ~seq, catches a torn or half copied element
+};
+
+struct ring_test {
+    struct spsc_ring ring;
+    struct ring_item buf[RING_COUNT];
+    uint32_t total;
+    uint32_t seed;
+    volatile bool failed;
+};
+
+static void *ring_producer(void *arg) {
+    struct ring_test *t = arg;
+    struct ring_item batch[RING_MAX_BATCH];
+    uint32_t state = t->seed;
+    uint32_t seq = 0;
+
+    while (seq < t->total && !t->failed) {
+        size_t count = 1 + rng_next(&state) % RING_MAX_BATCH;
+        if (count > t->total - seq) {
+            count = t->total - seq;
+        }
+        for (size_t i = 0; i < count; i++) {
+            batch[i].seq = seq + i;
+            batch[i].check = ~(seq + i);
+        }
+
+        // push the batch, exercising the single element calls too
+        size_t done = 0;
+        while (done < count && !t->failed) {
+            size_t n;
+            if (count - done == 1) {
+                n = spsc_ring_put(&t->ring, &batch[done]);
+            } else {
+                n = spsc_ring_enqueue(&t->ring, &batch[done], count - done);
+            }
+            // let the consumer in when the ring is full, the host may have a
+            // single cpu
+            if (n == 0) {
+                sched_yield();
+            }
+            done += n;
+        }
+        seq += count;
+    }
+    return NULL;
+}
+
+static void *ring_consumer(void *arg) {
+    struct ring_test *t = arg;
+    struct ring_item batch[RING_MAX_BATCH];
+    uint32_t state = t->seed * 7;
+    uint32_t expected = 0;
+
+    while (expected < t->total) {
+        size_t count = 1 + rng_next(&state) % RING_MAX_BATCH;
+        size_t got;
+        if (count == 1) {
+            got = spsc_ring_get(&t->ring, &batch[0]);
+        } else {
+            got = spsc_ring_dequeue(&t->ring, batch, count);
+        }
+        if (got == 0) {
+            sched_yield();
+            continue;
+        }
+        if (got > count) {
+            FAIL("dequeued %zu of %zu", got, count);
+            t->failed = true;
+            return NULL;
+        }
+
+        for (size_t i = 0; i < got; i++, expected++) {
+            if (batch[i].seq != expected || batch[i].check != ~expected) {
+                FAIL("got element %u (check %#x), expected %u", batch[i].seq, batch[i].check, expected);
+                t->failed = true;
+                return NULL;
+            }
+        }
+    }
+
+    // nothing extra was queued behind the last element
+    if (!spsc_ring_is_empty(&t->ring)) {
+        FAIL("%zu elements left over", spsc_ring_count(&t->ring));
+        t->failed = true;
+    }
+    return NULL;
+}
+
+static void test_spsc_ring(void) {
+    static struct ring_test t;
+    pthread_t producer, consumer;
+
+    spsc_ring_init(&t.ring, t.buf, RING_COUNT, sizeof(t.buf[0]));
+    t.ring.head = t.ring.tail = 0xffffffff - RING_COUNT * 100;
+    t.total = 4000000 * scale;
+    t.seed = rng() | 1;
+    t.failed = false;
+
+    pthread_create(&consumer, NULL, ring_consumer, &t);
+    pthread_create(&producer, NULL, ring_producer, &t);
+    pthread_join(producer, NULL);
+    pthread_join(consumer, NULL);
+
+    printf("hosttest: spsc_ring %u elements %s\n", t.total, t.failed ? "FAILED" : "ok");
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1) {
+        scale = strtoul(argv[1], NULL, 0);
+        if (scale == 0) {
+            fprintf(stderr, "usage: %s [iteration scale]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    test_miniheap();
+    test_spsc_ring();
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2019 Travis Geiselbrecht
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+// built against the kernel headers like the other kernel sources in the host
+// harness, so the inline list routines are the same code the kernel runs
+#include <list.h>
+#include <sys/types.h>
+
+struct item {
+    struct list_node node;
+    int val;
+};
+
+static struct item items[64];
+
+// fill a list from the tail and drain it from the head, iters times
+unsigned long list_bench(unsigned long iters) {
+    struct list_node list;
+    unsigned long sum = 0;
+
+    list_initialize(&list);
+    for (unsigned long i = 0; i < iters; i++) {
+        for (size_t j = 0; j < countof(items); j++) {
+            items[j].val = j;
+            list_add_tail(&list, &items[j].node);
+        }
+
+        struct item *it;
+        while ((it = list_remove_head_type(&list, struct item, node)) != NULL) {
+            sum += it->val;
+        }
+    }
+
+    return sum;
+}
@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2019 Travis Geiselbrecht
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <hw/ioapic.h>
+
+#include <stdio.h>
+#include <x86/mp.h>
+#include <x86/x86.h>
+
+// driver for the 82093aa compatible io apic
+
+// registers are reached indirectly through a select register and a window
+#define IOAPIC_REGSEL       0x00
+#define IOAPIC_WIN          0x10
+
+#define IOAPIC_VER          0x01
+#define IOAPIC_REDTBL(pin)  (0x10 + (pin) * 2)
+
+#define REDTBL_ACTIVE_LOW   (1 << 13)
+#define REDTBL_LEVEL        (1 << 15)
+#define REDTBL_MASKED       (1 << 16)
+
+// the IMCR sits between the 8259s and the cpu on boards that boot in PIC mode
+#define IMCR_INDEX          0x22
+#define IMCR_DATA           0x23
+#define IMCR_SELECT         0x70
+#define IMCR_APIC_MODE      0x01
+
+static volatile uint32_t *ioapic_base;
+static uint32_t ioapic_pins;
+
+// callers serialize, the select and window accesses must be paired
+static uint32_t ioapic_read(uint32_t reg) {
+    ioapic_base[IOAPIC_REGSEL / 4] = reg;
+    return ioapic_base[IOAPIC_WIN / 4];
+}
+
+static void ioapic_write(uint32_t reg, uint32_t val) {
+    ioapic_base[IOAPIC_REGSEL / 4] = reg;
+    ioapic_base[IOAPIC_WIN / 4] = val;
+}
+
+// the pin an isa irq is wired to, or -1 if it is off the end of this io apic
+static int isa_irq_pin(unsigned int irq) {
+    uint32_t pin = mp_config.isa_irq[irq].gsi - mp_config.ioapic_gsi_base;
+    return pin < ioapic_pins ? (int)pin : -1;
+}
+
+bool ioapic_init(void) {
+    if (!mp_config.ioapic_addr) {
+        return false;
+    }
+
+    ioapic_base = (volatile uint32_t *)mp_config.ioapic_addr;
+    ioapic_pins = ((ioapic_read(IOAPIC_VER) >> 16) & 0xff) + 1;
+
+    for (uint32_t pin = 0; pin < ioapic_pins; pin++) {
+        ioapic_write(IOAPIC_REDTBL(pin), REDTBL_MASKED);
+    }
+
+    // take the 8259s off the cpu's interrupt line
+    if (mp_config.imcr) {
+        outp(IMCR_INDEX, IMCR_SELECT);
+        outp(IMCR_DATA, IMCR_APIC_MODE);
+    }
+
+    printf("ioapic: id %u, %lu pins\n", mp_config.ioapic_id, ioapic_pins);
+    return true;
+}
+
+void ioapic_route_isa_irq(unsigned int irq, uint8_t vector, uint8_t apic_id) {
+    int pin = isa_irq_pin(irq);
+    if (pin < 0) {
+        return;
+    }
+
+    // isa irqs are active high and edge triggered unless the tables say otherwise
+    uint8_t flags = mp_config.isa_irq[irq].flags;
+    uint32_t lo = vector | REDTBL_MASKED;
+    if ((flags & MP_IRQ_POLARITY_MASK) == MP_IRQ_POLARITY_LOW) {
+        lo |= REDTBL_ACTIVE_LOW;
+    }
+    if ((flags & MP_IRQ_TRIGGER_MASK) == MP_IRQ_TRIGGER_LEVEL) {
+        lo |= REDTBL_LEVEL;
+    }
+
+    // physical destination, fixed delivery
+    ioapic_write(IOAPIC_REDTBL(pin) + 1, (uint32_t)apic_id << 24);
+    ioapic_write(IOAPIC_REDTBL(pin), lo);
+}
+
+void ioapic_set_isa_mask(unsigned int irq, bool masked) {
+    int pin = isa_irq_pin(irq);
+    if (pin < 0) {
+        return;
+    }
+
+    uint32_t lo = ioapic_read(IOAPIC_REDTBL(pin));
+    if (masked) {
+        lo |= REDTBL_MASKED;
+    } else {
+        lo &= ~REDTBL_MASKED;
+    }
+    ioapic_write(IOAPIC_REDTBL(pin), lo);
+}
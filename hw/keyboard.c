@@ -23,10 +23,15 @@
  */
 #include <hw/keyboard.h>
 
+#include <compiler.h>
 #include <console.h>
+#include <ctype.h>
+#include <delay.h>
+#include <spsc_ring.h>
 #include <stdio.h>
 #include <task.h>
 #include <time.h>
+#include <timer.h>
 #include <trace.h>
 #include <hw/pc.h>
 #include <hw/pic.h>
@@ -41,6 +46,9 @@
 // timeout in milliseconds
 #define I8042_CTL_TIMEOUT   500
 
+// how long to spin waiting for the controller to accept a byte, in microseconds
+#define I8042_WRITE_TIMEOUT 1000
+
 // status register bits
 #define I8042_STR_PARITY    0x80
 #define I8042_STR_TIMEOUT   0x40
@@ -88,230 +96,486 @@ static inline void i8042_write_command(int val) {
     outp(I8042_COMMAND_REG, val);
 }
 
-static inline void delay(uint32_t delay) {
-    // TODO: calibrate this to use some sort of realistic delay
-    for (uint32_t i = 0; i < delay * 10000; i++) {
-        asm volatile("nop");
-    }
+static int i8042_wait_write(void) {
+    return spin_until(!(i8042_read_status() & I8042_STR_IBF), I8042_WRITE_TIMEOUT) ? 0 : -1;
 }
 
-static int i8042_wait_read(void) {
-    int i = 0;
-    while ((~i8042_read_status() & I8042_STR_OBF) && (i < I8042_CTL_TIMEOUT)) {
-        delay(1);
-        i++;
-    }
-    return -(i == I8042_CTL_TIMEOUT);
-}
+/* scancodes we want to do something with that don't translate via table */
+#define SCANCODE_EXTENDED   0xe0
+#define SCANCODE_PAUSE      0xe1    // followed by 5 more bytes, no break code
+#define SCANCODE_ACK        0xfa
+#define SCANCODE_RESEND     0xfe
 
-static int i8042_wait_write(void) {
-    int i = 0;
-    while ((i8042_read_status() & I8042_STR_IBF) && (i < I8042_CTL_TIMEOUT)) {
-        delay(1);
-        i++;
-    }
-    return -(i == I8042_CTL_TIMEOUT);
-}
+/* keypad scancodes that change meaning with num lock */
+#define SCANCODE_KP_FIRST   0x47
+#define SCANCODE_KP_LAST    0x53
 
-static int i8042_flush(void) {
-    unsigned char data __UNUSED;
-    int i = 0;
+/* commands sent to the keyboard itself */
+#define KBD_CMD_SET_LEDS    0xed
 
-    enter_critical_section();
+#define KBD_LED_SCROLLLOCK  0x01
+#define KBD_LED_NUMLOCK     0x02
+#define KBD_LED_CAPSLOCK    0x04
 
-    while ((i8042_read_status() & I8042_STR_OBF) && (i++ < I8042_BUFFER_LENGTH)) {
-        printf("i8042_flush %d\n", i);
-        delay(1);
-        data = i8042_read_data();
-    }
+// how long to wait for the keyboard to ack each byte of an led update, in milliseconds
+#define KBD_LED_TIMEOUT     100
 
-    exit_critical_section();
+/* scancode set 1 translation tables */
+static const int KeyCodeSingleLower[] = {
+// 0    1    2    3    4    5    6    7    8    9    A    B    C    D    E    F
+    -1, KEY_ESC, '1', '2', '3', '4', '5', '6', '7', '8', '9', '0', '-', '=','\b','\t', // 0
+        'q', 'w', 'e', 'r', 't', 'y', 'u', 'i', 'o', 'p', '[', ']','\n', KEY_LCTRL, 'a', 's', // 1
+        'd', 'f', 'g', 'h', 'j', 'k', 'l', ';','\'', '`', KEY_LSHIFT,'\\', 'z', 'x', 'c', 'v', // 2
+        'b', 'n', 'm', ',', '.', '/', KEY_RSHIFT, '*', KEY_LALT, ' ', KEY_CAPSLOCK, KEY_F1, KEY_F2, KEY_F3, KEY_F4, KEY_F5, // 3
+        KEY_F6, KEY_F7, KEY_F8, KEY_F9, KEY_F10, KEY_NUMLOCK, KEY_SCROLLLOCK, KEY_HOME, KEY_UP, KEY_PGUP, '-', KEY_LEFT,  -1, KEY_RIGHT, '+', KEY_END, // 4
+        KEY_DOWN, KEY_PGDN, KEY_INS, KEY_DEL,  -1,  -1,'\\', KEY_F11, KEY_F12,  -1,  -1,  -1,  -1,  -1,  -1,  -1, // 5
+        -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1, // 6
+        -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1, // 7
+    };
 
-    return i;
+static const int KeyCodeSingleUpper[] = {
+// 0    1    2    3    4    5    6    7    8    9    A    B    C    D    E    F
+    -1, KEY_ESC, '!', '@', '#', '$', '%', '^', '&', '*', '(', ')', '_', '+','\b','\t', // 0
+        'Q', 'W', 'E', 'R', 'T', 'Y', 'U', 'I', 'O', 'P', '{', '}','\n', KEY_LCTRL, 'A', 'S', // 1
+        'D', 'F', 'G', 'H', 'J', 'K', 'L', ':', '"', '~', KEY_LSHIFT, '|', 'Z', 'X', 'C', 'V', // 2
+        'B', 'N', 'M', '<', '>', '?', KEY_RSHIFT, '*', KEY_LALT, ' ', KEY_CAPSLOCK, KEY_F1, KEY_F2, KEY_F3, KEY_F4, KEY_F5, // 3
+        KEY_F6, KEY_F7, KEY_F8, KEY_F9, KEY_F10, KEY_NUMLOCK, KEY_SCROLLLOCK, KEY_HOME, KEY_UP, KEY_PGUP, '-', KEY_LEFT,  -1, KEY_RIGHT, '+', KEY_END, // 4
+        KEY_DOWN, KEY_PGDN, KEY_INS, KEY_DEL,  -1,  -1, '|', KEY_F11, KEY_F12,  -1,  -1,  -1,  -1,  -1,  -1,  -1, // 5
+        -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1, // 6
+        -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1, // 7
+    };
+
+/* codes following a 0xe0 prefix, these don't change with shift */
+static const int KeyCodeMulti[] = {
+// 0    1    2    3    4    5    6    7    8    9    A    B    C    D    E    F
+    -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1, // 0
+        -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,'\n', KEY_RCTRL,  -1,  -1, // 1
+        -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1, // 2
+        -1,  -1,  -1,  -1,  -1, '/',  -1, KEY_PRTSCR, KEY_RALT,  -1,  -1,  -1,  -1,  -1,  -1,  -1, // 3
+        -1,  -1,  -1,  -1,  -1,  -1,  -1, KEY_HOME, KEY_UP, KEY_PGUP,  -1, KEY_LEFT,  -1, KEY_RIGHT,  -1, KEY_END, // 4
+        KEY_DOWN, KEY_PGDN, KEY_INS, KEY_DEL,  -1,  -1,  -1,  -1,  -1,  -1,  -1, KEY_LGUI, KEY_RGUI, KEY_MENU,  -1,  -1, // 5
+        -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1, // 6
+        -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1, // 7
+    };
+
+/* keypad keys with num lock on */
+static const int KeyCodeKeypad[] = {
+    '7', '8', '9',  -1, '4', '5', '6',  -1, '1', '2', '3', '0', '.'
+};
+
+// escape sequences sent to the console for keys that have no ascii code,
+// matching what a vt100/xterm style terminal sends on the serial port
+static const struct {
+    int key;
+    const char *seq;
+} key_sequences[] = {
+    { KEY_UP, "\x1b[A" },
+    { KEY_DOWN, "\x1b[B" },
+    { KEY_RIGHT, "\x1b[C" },
+    { KEY_LEFT, "\x1b[D" },
+    { KEY_HOME, "\x1b[H" },
+    { KEY_END, "\x1b[F" },
+    { KEY_INS, "\x1b[2~" },
+    { KEY_DEL, "\x1b[3~" },
+    { KEY_PGUP, "\x1b[5~" },
+    { KEY_PGDN, "\x1b[6~" },
+    { KEY_F1, "\x1bOP" },
+    { KEY_F2, "\x1bOQ" },
+    { KEY_F3, "\x1bOR" },
+    { KEY_F4, "\x1bOS" },
+    { KEY_F5, "\x1b[15~" },
+    { KEY_F6, "\x1b[17~" },
+    { KEY_F7, "\x1b[18~" },
+    { KEY_F8, "\x1b[19~" },
+    { KEY_F9, "\x1b[20~" },
+    { KEY_F10, "\x1b[21~" },
+    { KEY_F11, "\x1b[23~" },
+    { KEY_F12, "\x1b[24~" },
+};
+
+// keyboard state, only touched by the keyboard task
+static unsigned int key_mods;               // KEY_MOD_* bits currently active
+static uint32_t keys_down[256 / 32];        // bitmap of keys held, extended keys in the upper half
+static keyboard_listener_t key_listener;
+
+static enum {
+    LED_IDLE,
+    LED_SENT_CMD,
+    LED_SENT_DATA,
+} led_phase;
+static uint8_t led_state;
+static bool led_dirty;
+static timer_t led_timer = TIMER_INITIAL_VALUE(led_timer);
+
+// the keyboard never acked, give up on this exchange so the next lock key
+// press can start another
+static void keyboard_led_timeout(timer_t *t, uint32_t now, void *arg) {
+    led_phase = LED_IDLE;
+    led_dirty = false;
 }
 
-static int i8042_command(uint8_t *param, int command) {
-    int retval = 0, i = 0;
+static void keyboard_send(uint8_t val) {
+    if (i8042_wait_write()) {
+        // give up on this exchange, the next lock key press will try again
+        led_phase = LED_IDLE;
+        timer_cancel(&led_timer);
+        return;
+    }
+    i8042_write_data(val);
+    timer_set_oneshot(&led_timer, KBD_LED_TIMEOUT, &keyboard_led_timeout, NULL);
+}
 
-    enter_critical_section();
-    //TRACEF("param %p, command %#x\n", param, command);
+// kick off an update of the lock leds. the keyboard acks each byte, and the
+// acks come back through the scancode stream to keyboard_led_response()
+static void keyboard_update_leds(void) {
+    led_state = ((key_mods & KEY_MOD_SCROLLLOCK) ? KBD_LED_SCROLLLOCK : 0) |
+                ((key_mods & KEY_MOD_NUMLOCK) ? KBD_LED_NUMLOCK : 0) |
+                ((key_mods & KEY_MOD_CAPSLOCK) ? KBD_LED_CAPSLOCK : 0);
 
-    retval = i8042_wait_write();
-    if (!retval) {
-        i8042_write_command(command & 0xff);
+    if (led_phase != LED_IDLE) {
+        led_dirty = true;
+        return;
     }
 
-    if (!retval) {
-        for (i = 0; i < ((command >> 12) & 0xf); i++) {
-            if ((retval = i8042_wait_write())) {
-                break;
+    led_phase = LED_SENT_CMD;
+    keyboard_send(KBD_CMD_SET_LEDS);
+}
+
+static void keyboard_led_response(uint8_t scode) {
+    switch (led_phase) {
+        case LED_SENT_CMD:
+            if (scode == SCANCODE_ACK) {
+                led_phase = LED_SENT_DATA;
+                keyboard_send(led_state);
+            } else {
+                keyboard_send(KBD_CMD_SET_LEDS);
             }
+            break;
+        case LED_SENT_DATA:
+            if (scode == SCANCODE_ACK) {
+                led_phase = LED_IDLE;
+                timer_cancel(&led_timer);
+                if (led_dirty) {
+                    led_dirty = false;
+                    keyboard_update_leds();
+                }
+            } else {
+                keyboard_send(led_state);
+            }
+            break;
+        default:
+            break;
+    }
+}
 
-            i8042_write_data(param[i]);
+static void keyboard_to_console(int key, unsigned int flags) {
+    if (flags & KEY_FLAG_UP) {
+        return;
+    }
+
+    if (key < 0x80) {
+        if ((flags & KEY_MOD_CTRL) && isalpha(key)) {
+            key &= 0x1f;
         }
+        console_input(key);
+        return;
     }
 
-    if (!retval) {
-        for (i = 0; i < ((command & 0xf0) >> 8); i++) {
-            if ((retval = i8042_wait_read())) {
-                break;
+    for (size_t i = 0; i < countof(key_sequences); i++) {
+        if (key_sequences[i].key == key) {
+            for (const char *s = key_sequences[i].seq; *s; s++) {
+                console_input(*s);
             }
+            return;
+        }
+    }
+}
 
-            if (i8042_read_status() & I8042_STR_AUXDATA) {
-                param[i] = ~i8042_read_data();
-            } else {
-                param[i] = i8042_read_data();
+static void process_key(int key, bool multi, uint8_t code, bool up) {
+    // track which keys are held, a make code for a key already down is a typematic repeat
+    unsigned int index = code | (multi ? 0x80 : 0);
+    uint32_t bit = 1u << (index % 32);
+    bool repeat = !up && (keys_down[index / 32] & bit);
+    if (up) {
+        keys_down[index / 32] &= ~bit;
+    } else {
+        keys_down[index / 32] |= bit;
+    }
+
+    unsigned int mod = 0;
+    switch (key) {
+        case KEY_LSHIFT: mod = KEY_MOD_LSHIFT; break;
+        case KEY_RSHIFT: mod = KEY_MOD_RSHIFT; break;
+        case KEY_LCTRL: mod = KEY_MOD_LCTRL; break;
+        case KEY_RCTRL: mod = KEY_MOD_RCTRL; break;
+        case KEY_LALT: mod = KEY_MOD_LALT; break;
+        case KEY_RALT: mod = KEY_MOD_RALT; break;
+        case KEY_CAPSLOCK:
+        case KEY_NUMLOCK:
+        case KEY_SCROLLLOCK:
+            // locks toggle on the initial press only
+            if (!up && !repeat) {
+                key_mods ^= (key == KEY_CAPSLOCK) ? KEY_MOD_CAPSLOCK :
+                            (key == KEY_NUMLOCK) ? KEY_MOD_NUMLOCK : KEY_MOD_SCROLLLOCK;
+                keyboard_update_leds();
             }
+            break;
+    }
+    if (mod) {
+        if (up) {
+            key_mods &= ~mod;
+        } else {
+            key_mods |= mod;
         }
     }
 
-    exit_critical_section();
-
-    return retval;
-}
+    if (!multi) {
+        bool shift = key_mods & KEY_MOD_SHIFT;
+        if (code >= SCANCODE_KP_FIRST && code <= SCANCODE_KP_LAST &&
+                KeyCodeKeypad[code - SCANCODE_KP_FIRST] != -1) {
+            // num lock and shift cancel each other out on the keypad
+            if (!!(key_mods & KEY_MOD_NUMLOCK) != shift) {
+                key = KeyCodeKeypad[code - SCANCODE_KP_FIRST];
+            }
+        } else if (shift) {
+            key = KeyCodeSingleUpper[code];
+        }
+    }
 
-/* scancodes we want to do something with that don't translate via table */
-#define SCANCODE_LSHIFT 0x2a
-#define SCANCODE_RSHIFT 0x36
+    if ((key_mods & KEY_MOD_CAPSLOCK) && isalpha(key)) {
+        key = islower(key) ? toupper(key) : tolower(key);
+    }
 
-/* scancode translation tables */
-static const int KeyCodeSingleLower[] = {
-// 0    1    2    3    4    5    6    7    8    9    A    B    C    D    E    F
-    -1,  -1, '1', '2', '3', '4', '5', '6', '7', '8', '9', '0', '-', '=','\b','\t', // 0
-        'q', 'w', 'e', 'r', 't', 'y', 'u', 'i', 'o', 'p', '[', ']','\n',  -1, 'a', 's', // 1
-        'd', 'f', 'g', 'h', 'j', 'k', 'l', ';','\'', '`',  -1,'\\', 'z', 'x', 'c', 'v', // 2
-        'b', 'n', 'm', ',', '.', '/',  -1, '*',  -1, ' ',  -1,  -1,  -1,  -1,  -1,  -1, // 3
-        -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1, // 4
-        -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1, // 5
-        -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1, // 6
-        -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1, // 7
-    };
+    if (key < 0) {
+        return;
+    }
 
-static const int KeyCodeMultiLower[] = {
-// 0    1    2    3    4    5    6    7    8    9    A    B    C    D    E    F
-    -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1, // 0
-        -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1, // 1
-        -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1, // 2
-        -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1, // 3
-        -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1, // 4
-        -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1, // 5
-        -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1, // 6
-        -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1, // 7
-    };
+    unsigned int flags = key_mods | (up ? KEY_FLAG_UP : 0) | (repeat ? KEY_FLAG_REPEAT : 0);
+    if (key_listener) {
+        key_listener(key, flags);
+    } else {
+        keyboard_to_console(key, flags);
+    }
+}
 
-static const int KeyCodeSingleUpper[] = {
-// 0    1    2    3    4    5    6    7    8    9    A    B    C    D    E    F
-    -1,  -1, '!', '@', '#', '$', '%', '^', '&', '*', '(', ')', '_', '+','\b','\t', // 0
-        'Q', 'W', 'E', 'R', 'T', 'Y', 'U', 'I', 'O', 'P', '{', '}','\n',  -1, 'A', 'S', // 1
-        'D', 'F', 'G', 'H', 'J', 'K', 'L', ':', '"', '~',  -1, '|', 'Z', 'X', 'C', 'V', // 2
-        'B', 'N', 'M', '<', '>', '?',  -1, '*',  -1, ' ',  -1,  -1,  -1,  -1,  -1,  -1, // 3
-        -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1, // 4
-        -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1, // 5
-        -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1, // 6
-        -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1, // 7
-    };
+static void process_scode(uint8_t scode) {
+    // state
+    static bool extended;
+    static int pause_bytes;
 
-static const int KeyCodeMultiUpper[] = {
-// 0    1    2    3    4    5    6    7    8    9    A    B    C    D    E    F
-    -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1, // 0
-        -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1, // 1
-        -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1, // 2
-        -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1, // 3
-        -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1, // 4
-        -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1, // 5
-        -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1, // 6
-        -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1, // 7
-    };
+    // responses to commands we sent to the keyboard
+    if (scode == SCANCODE_ACK || scode == SCANCODE_RESEND) {
+        keyboard_led_response(scode);
+        return;
+    }
 
-static void process_scode(uint8_t scode, unsigned int flags) {
-    // state
-    static bool key_lshift;
-    static bool key_rshift;
-    static int lastCode = 0;
+    // the pause key sends a fixed 6 byte sequence on press and nothing on release
+    if (pause_bytes > 0) {
+        if (--pause_bytes == 0) {
+            process_key(KEY_PAUSE, true, 0x45, false);
+            process_key(KEY_PAUSE, true, 0x45, true);
+        }
+        return;
+    }
+    if (scode == SCANCODE_PAUSE) {
+        pause_bytes = 5;
+        return;
+    }
 
-    int keyCode;
-    uint8_t keyUpBit;
+    if (scode == SCANCODE_EXTENDED) {
+        extended = true;
+        return;
+    }
 
-    bool multi = lastCode == 0xe0;
+    bool multi = extended;
+    extended = false;
 
     // save the key up event bit
-    keyUpBit = scode & 0x80;
+    bool up = scode & 0x80;
     scode &= 0x7f;
 
-    if (scode == SCANCODE_LSHIFT) {
-        key_lshift = !keyUpBit;
-    }
+    int key = multi ? KeyCodeMulti[scode] : KeyCodeSingleLower[scode];
 
-    if (scode == SCANCODE_RSHIFT) {
-        key_rshift = !keyUpBit;
+    // keypad 5 only means something with num lock, let process_key() map it
+    bool keypad = !multi && scode >= SCANCODE_KP_FIRST && scode <= SCANCODE_KP_LAST;
+    if (key == -1 && !keypad) {
+        // includes the fake shifts that surround some extended keys
+        return;
     }
 
-    if (key_lshift || key_rshift) {
-        keyCode = multi ? KeyCodeMultiUpper[scode] : KeyCodeSingleUpper[scode];
-    } else {
-        keyCode = multi ? KeyCodeMultiLower[scode] : KeyCodeSingleLower[scode];
-    }
+    process_key(key, multi, scode, up);
+}
+
+void keyboard_set_listener(keyboard_listener_t listener) {
+    key_listener = listener;
+}
 
-    /*printf_xy(71, 3, BLUE, "%02x%02x %c %c%c", multi ? lastCode : 0, scode,
-        keyCode != -1 ? (char) keyCode : ' ', key_lshift ? 'L' : ' ',
-        key_rshift ? 'R' : ' ');*/
+// raw scancodes are handed from the irq handler to the keyboard task
+static uint8_t scode_buf[64];
+static struct spsc_ring scode_ring = SPSC_RING_INITIAL_VALUE(scode_buf);
+static wait_queue_t scode_wait = WAIT_QUEUE_INITIAL_VALUE(scode_wait);
+
+static task_t keyboard_task;
+static uint8_t keyboard_stack[1024] __ALIGNED(4);
+
+// controller setup runs as a state machine stepped from the keyboard irq and a
+// polling timer, so none of it spins with interrupts off and boot carries on
+// while the controller responds.
+static enum {
+    I8042_INIT_IDLE,
+    I8042_INIT_FLUSH,
+    I8042_INIT_READ_CTR,        // send the read CTR command
+    I8042_INIT_WAIT_CTR,        // wait for the CTR value
+    I8042_INIT_WRITE_CTR,       // send the write CTR command
+    I8042_INIT_WRITE_CTR_DATA,  // send the new CTR value
+    I8042_INIT_DONE,
+    I8042_INIT_FAILED,
+} i8042_init_state;
+
+static uint8_t i8042_ctr;
+static uint32_t i8042_deadline;
+static timer_t i8042_timer = TIMER_INITIAL_VALUE(i8042_timer);
+
+#define I8042_POLL_INTERVAL 1   // in milliseconds
+
+static void i8042_init_timer(timer_t *t, uint32_t now, void *arg);
+
+static void i8042_init_next(int state) {
+    i8042_init_state = state;
+    i8042_deadline = current_time() + I8042_CTL_TIMEOUT;
+}
 
-    if (keyCode != -1 && !keyUpBit) {
-        char c = (char) keyCode;
-        console_input(c);
+// advance the controller setup as far as it can go without waiting.
+// called with interrupts disabled.
+static void i8042_init_step(void) {
+    for (;;) {
+        uint8_t str = i8042_read_status();
+
+        switch (i8042_init_state) {
+            case I8042_INIT_FLUSH:
+                for (int i = 0; (str & I8042_STR_OBF) && i < I8042_BUFFER_LENGTH; i++) {
+                    i8042_read_data();
+                    str = i8042_read_status();
+                }
+                i8042_init_next(I8042_INIT_READ_CTR);
+                continue;
+            case I8042_INIT_READ_CTR:
+                if (str & I8042_STR_IBF) {
+                    break;
+                }
+                i8042_write_command(I8042_CMD_CTL_RCTR & 0xff);
+                i8042_init_next(I8042_INIT_WAIT_CTR);
+                continue;
+            case I8042_INIT_WAIT_CTR:
+                if (~str & I8042_STR_OBF) {
+                    break;
+                }
+                if (str & I8042_STR_AUXDATA) {
+                    // stray mouse data, keep waiting for the CTR
+                    i8042_read_data();
+                    continue;
+                }
+                i8042_ctr = i8042_read_data();
+
+                // turn on translation
+                i8042_ctr |= I8042_CTR_XLATE;
+
+                // enable keyboard and keyboard irq
+                i8042_ctr &= ~I8042_CTR_KBDDIS;
+                i8042_ctr |= I8042_CTR_KBDINT;
+
+                i8042_init_next(I8042_INIT_WRITE_CTR);
+                continue;
+            case I8042_INIT_WRITE_CTR:
+                if (str & I8042_STR_IBF) {
+                    break;
+                }
+                i8042_write_command(I8042_CMD_CTL_WCTR & 0xff);
+                i8042_init_next(I8042_INIT_WRITE_CTR_DATA);
+                continue;
+            case I8042_INIT_WRITE_CTR_DATA:
+                if (str & I8042_STR_IBF) {
+                    break;
+                }
+                i8042_write_data(i8042_ctr);
+                i8042_init_state = I8042_INIT_DONE;
+                timer_cancel(&i8042_timer);
+                printf("i8042 initialized, ctr %#x\n", i8042_ctr);
+                return;
+            default:
+                return;
+        }
+
+        // waiting on the controller, check for a timeout and poll again shortly
+        if ((int32_t)(current_time() - i8042_deadline) >= 0) {
+            printf("i8042 timed out in state %d while initializing\n", i8042_init_state);
+            i8042_init_state = I8042_INIT_FAILED;
+            timer_cancel(&i8042_timer);
+            pic_set_mask(IRQ_KEYBOARD, true);
+            return;
+        }
+        timer_set_oneshot(&i8042_timer, I8042_POLL_INTERVAL, &i8042_init_timer, NULL);
+        return;
     }
+}
 
-    // update the last received code
-    lastCode = scode;
+static void i8042_init_timer(timer_t *t, uint32_t now, void *arg) {
+    i8042_init_step();
 }
 
-__NO_INLINE void keyboard_irq(void) {
+static void keyboard_irq(void *arg) {
     uint8_t str, data = 0;
 
+    if (i8042_init_state != I8042_INIT_DONE) {
+        i8042_init_step();
+        return;
+    }
+
     str = i8042_read_status();
     if (str & I8042_STR_OBF) {
         data = i8042_read_data();
-    }
 
-    if (str & I8042_STR_OBF) {
-        //printf("%#x\n", data);
-        process_scode(data,
-                      ((str & I8042_STR_PARITY) ? I8042_STR_PARITY : 0) |
-                      ((str & I8042_STR_TIMEOUT) ? I8042_STR_TIMEOUT : 0));
+        // if the ring is full the scancode is dropped
+        spsc_ring_put(&scode_ring, &data);
+        wait_queue_wake_one(&scode_wait);
     }
 }
 
-void keyboard_init(void) {
-    uint8_t ctr;
-
-    TRACE;
-    i8042_flush();
+static void keyboard_thread(void *arg) {
+    uint8_t scodes[16];
 
-    TRACE;
-    ctr = 0;
-    if (i8042_command(&ctr, I8042_CMD_CTL_RCTR)) {
-        printf("Failed to read CTR while initializing i8042\n");
-        return;
+    for (;;) {
+        enter_critical_section();
+        while (spsc_ring_is_empty(&scode_ring)) {
+            wait_queue_block(&scode_wait);
+        }
+        exit_critical_section();
+
+        size_t count = spsc_ring_dequeue(&scode_ring, scodes, sizeof(scodes));
+        for (size_t i = 0; i < count; i++) {
+            // console input is shared with other irq driven devices
+            enter_critical_section();
+            process_scode(scodes[i]);
+            exit_critical_section();
+        }
     }
-    TRACE;
-
-    // turn on translation
-    ctr |= I8042_CTR_XLATE;
+}
 
-    // enable keyboard and keyboard irq
-    ctr &= ~I8042_CTR_KBDDIS;
-    ctr |= I8042_CTR_KBDINT;
+// start bringing up the controller and return, the rest happens in the background
+void keyboard_init(void) {
+    task_create(&keyboard_task, "keyboard", &keyboard_thread, NULL, (uintptr_t)keyboard_stack, sizeof(keyboard_stack));
+    task_start(&keyboard_task);
 
-    TRACE;
-    if (i8042_command(&ctr, I8042_CMD_CTL_WCTR)) {
-        printf("Failed to write CTR while initializing i8042\n");
-        return;
-    }
+    enter_critical_section();
 
-    TRACE;
-    // eoi and unmask the keyboard irq
+    // eoi and unmask the keyboard irq, controller responses may arrive through it
+    register_irq_handler(IRQ_KEYBOARD, &keyboard_irq, NULL);
     pic_send_eoi(IRQ_KEYBOARD);
     pic_set_mask(IRQ_KEYBOARD, false);
-    TRACE;
+
+    i8042_init_next(I8042_INIT_FLUSH);
+    i8042_init_step();
+
+    exit_critical_section();
 }
 
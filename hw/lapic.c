@@ -0,0 +1,263 @@
+/*
+ * Copyright (c) 2019 Travis Geiselbrecht
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <hw/lapic.h>
+
+#include <delay.h>
+#include <smp.h>
+#include <stdio.h>
+#include <task.h>
+#include <time.h>
+#include <timer.h>
+#include <hw/pit.h>
+#include <x86/x86.h>
+
+// driver for the local apic, used to start and interrupt the other cpus
+
+#define LAPIC_ID            0x020
+#define LAPIC_TPR           0x080
+#define LAPIC_EOI           0x0b0
+#define LAPIC_SVR           0x0f0
+#define LAPIC_IRR           0x200
+#define LAPIC_ESR           0x280
+#define LAPIC_ICR_LO        0x300
+#define LAPIC_ICR_HI        0x310
+#define LAPIC_LVT_TIMER     0x320
+#define LAPIC_LVT_LINT0     0x350
+#define LAPIC_LVT_LINT1     0x360
+#define LAPIC_LVT_ERROR     0x370
+#define LAPIC_TIMER_ICR     0x380
+#define LAPIC_TIMER_CCR     0x390
+#define LAPIC_TIMER_DCR     0x3e0
+
+#define LAPIC_SVR_ENABLE    (1 << 8)
+#define LAPIC_LVT_MASKED    (1 << 16)
+
+#define LAPIC_TIMER_DIV_16  0x3
+
+// how long a task runs before the timer preempts it, in ms
+#define LAPIC_TIMER_SLICE_MS 10
+
+#define ICR_INIT            (5 << 8)
+#define ICR_STARTUP         (6 << 8)
+#define ICR_PENDING         (1 << 12)
+#define ICR_ASSERT          (1 << 14)
+#define ICR_LEVEL           (1 << 15)
+
+static volatile uint32_t *lapic_base;
+
+// timer counts per ms at the divide by 16 rate, 0 until calibrated
+static uint32_t lapic_timer_per_ms;
+
+// when each cpu's current time slice runs out, in current_time() ms
+static uint32_t slice_end[SMP_MAX_CPUS];
+
+static inline uint32_t lapic_read(uint32_t reg) {
+    return lapic_base[reg / 4];
+}
+
+static inline void lapic_write(uint32_t reg, uint32_t val) {
+    lapic_base[reg / 4] = val;
+}
+
+void lapic_set_base(uintptr_t base) {
+    lapic_base = (volatile uint32_t *)base;
+}
+
+bool lapic_present(void) {
+    return lapic_base != NULL;
+}
+
+void lapic_init(bool bsp) {
+    // the bsp keeps lint0 and lint1 as the bios set them up, which routes the
+    // 8259 through lint0 in virtual wire mode. the other cpus take no legacy irqs.
+    if (!bsp) {
+        lapic_write(LAPIC_LVT_LINT0, LAPIC_LVT_MASKED);
+        lapic_write(LAPIC_LVT_LINT1, LAPIC_LVT_MASKED);
+    }
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASKED);
+    lapic_write(LAPIC_LVT_ERROR, LAPIC_LVT_MASKED);
+
+    lapic_write(LAPIC_TPR, 0);
+    lapic_write(LAPIC_SVR, LAPIC_SVR_ENABLE | LAPIC_VECTOR_SPURIOUS);
+
+    // clear any errors from before we took over, the register needs a write first
+    lapic_write(LAPIC_ESR, 0);
+    lapic_read(LAPIC_ESR);
+}
+
+uint32_t lapic_get_id(void) {
+    return lapic_read(LAPIC_ID) >> 24;
+}
+
+void lapic_send_eoi(void) {
+    lapic_write(LAPIC_EOI, 0);
+}
+
+uint32_t lapic_get_irr(unsigned int vector) {
+    return lapic_read(LAPIC_IRR + (vector / 32) * 0x10);
+}
+
+// count the timer down across half a PIT period with irqs disabled, so at most
+// one PIT reload goes by unseen, which pit_read_clocks() accounts for
+static void lapic_timer_calibrate(void) {
+    x86_flags_t flags = x86_irq_disable();
+
+    lapic_write(LAPIC_TIMER_DCR, LAPIC_TIMER_DIV_16);
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASKED);
+
+    uint64_t clocks_start = pit_read_clocks();
+    lapic_write(LAPIC_TIMER_ICR, UINT32_MAX);
+
+    uint64_t clocks_end;
+    do {
+        clocks_end = pit_read_clocks();
+    } while (clocks_end - clocks_start < pit_get_countdown() / 2u);
+
+    uint32_t counts = UINT32_MAX - lapic_read(LAPIC_TIMER_CCR);
+    lapic_write(LAPIC_TIMER_ICR, 0);
+
+    x86_irq_restore(flags);
+
+    lapic_timer_per_ms = ((uint64_t)counts * PIT_FREQ) / ((clocks_end - clocks_start) * 1000);
+    if (lapic_timer_per_ms == 0) {
+        lapic_timer_per_ms = 1;
+    }
+
+    printf("lapic: timer at %lu kHz\n", lapic_timer_per_ms);
+}
+
+// arm this cpu's timer for the end of its slice or the next kernel timer
+static void lapic_timer_arm(bool has_deadline, uint32_t deadline) {
+    uint32_t next = slice_end[smp_cpu_num()];
+    if (has_deadline && (int32_t)(deadline - next) < 0) {
+        next = deadline;
+    }
+
+    // current_time() rounds down, so a whole ms from now covers any deadline
+    // that has already come due
+    int32_t delta = next - current_time();
+    if (delta < 1) {
+        delta = 1;
+    }
+
+    lapic_write(LAPIC_TIMER_ICR, delta * lapic_timer_per_ms);
+}
+
+void lapic_timer_init(void) {
+    if (!lapic_timer_per_ms) {
+        lapic_timer_calibrate();
+    }
+
+    slice_end[smp_cpu_num()] = current_time() + LAPIC_TIMER_SLICE_MS;
+
+    lapic_write(LAPIC_TIMER_DCR, LAPIC_TIMER_DIV_16);
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_VECTOR_TIMER); // one shot, unmasked
+
+    uint32_t deadline = 0;
+    bool has_deadline = timer_get_deadline(&deadline);
+    lapic_timer_arm(has_deadline, deadline);
+}
+
+bool lapic_timer_running(void) {
+    return lapic_timer_per_ms != 0;
+}
+
+void lapic_timer_set_deadline(uint32_t deadline) {
+    if (lapic_timer_running()) {
+        lapic_timer_arm(true, deadline);
+    }
+}
+
+// expire kernel timers, preempt the current task at the end of its slice and
+// rearm. irq context, so the kernel lock covering the timer queue is held.
+static void lapic_timer_irq(void) {
+    uint32_t now = current_time();
+    uint32_t cpu_num = smp_cpu_num();
+
+    timer_tick(now);
+
+    if ((int32_t)(now - slice_end[cpu_num]) >= 0) {
+        slice_end[cpu_num] = now + LAPIC_TIMER_SLICE_MS;
+        if (!task_is_idle()) {
+            task_set_need_resched();
+        }
+    }
+
+    uint32_t deadline = 0;
+    bool has_deadline = timer_get_deadline(&deadline);
+    lapic_timer_arm(has_deadline, deadline);
+}
+
+static void lapic_send_icr(uint32_t apic_id, uint32_t val) {
+    x86_flags_t flags = x86_irq_disable();
+
+    lapic_write(LAPIC_ICR_HI, apic_id << 24);
+    lapic_write(LAPIC_ICR_LO, val);
+    while (lapic_read(LAPIC_ICR_LO) & ICR_PENDING) {
+        ;
+    }
+
+    x86_irq_restore(flags);
+}
+
+void lapic_send_ipi(uint32_t apic_id, uint32_t vector) {
+    lapic_send_icr(apic_id, ICR_ASSERT | vector);
+}
+
+void lapic_stop_ap(uint32_t apic_id) {
+    lapic_send_icr(apic_id, ICR_INIT | ICR_ASSERT | ICR_LEVEL);
+    mdelay(10);
+    lapic_send_icr(apic_id, ICR_INIT | ICR_LEVEL);
+}
+
+void lapic_start_ap(uint32_t apic_id, uintptr_t entry) {
+    // INIT, then the deassert that the original 82489dx wants
+    lapic_stop_ap(apic_id);
+
+    // two startups, as the MP spec asks for, the second is ignored if the
+    // first one took
+    for (int i = 0; i < 2; i++) {
+        lapic_send_icr(apic_id, ICR_STARTUP | (entry >> 12));
+        udelay(200);
+    }
+}
+
+void lapic_irq(unsigned int vector) {
+    switch (vector) {
+        case LAPIC_VECTOR_RESCHEDULE:
+            lapic_send_eoi();
+            task_set_need_resched();
+            break;
+        case LAPIC_VECTOR_TIMER:
+            lapic_send_eoi();
+            lapic_timer_irq();
+            break;
+        case LAPIC_VECTOR_SPURIOUS:
+            // no eoi for a spurious interrupt
+            break;
+        default:
+            lapic_send_eoi();
+            printf("lapic: unexpected vector %#x on cpu %lu\n", vector, smp_cpu_num());
+            break;
+    }
+}
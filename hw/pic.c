@@ -22,10 +22,17 @@
  */
 #include <hw/pic.h>
 
+#include <compiler.h>
+#include <kcounter.h>
+#include <ktrace.h>
+#include <spinlock.h>
+#include <stddef.h>
 #include <stdio.h>
-#include <hw/keyboard.h>
+#include <task.h>
+#include <time.h>
+#include <hw/ioapic.h>
+#include <hw/lapic.h>
 #include <hw/pc.h>
-#include <hw/pit.h>
 #include <x86/x86.h>
 
 // driver for the pair of 8259a interrupt controllers present on legacy PCs
@@ -52,6 +59,41 @@
 #define ICW4_SFNM       0x10        /* Special fully nested (not) */
 
 #define PIC_EOI         0x20        /* End-of-interrupt command code */
+#define PIC_READ_IRR    0x0a        /* OCW3 irq ready next CMD read */
+#define PIC_READ_ISR    0x0b        /* OCW3 irq service next CMD read */
+
+#define MAX_IRQ_HANDLERS 32
+
+struct irq_handler {
+    irq_handler_t handler;
+    void *arg;
+    struct irq_handler *next;
+};
+
+struct irq_stats {
+    uint32_t count;
+    uint32_t spurious;
+    uint64_t time_ns;   // cumulative time spent in handlers
+};
+
+static struct irq_handler handler_pool[MAX_IRQ_HANDLERS];
+static struct irq_handler *irq_handlers[NUM_IRQS];
+static struct irq_stats irq_stats[NUM_IRQS];
+
+// totals across all lines, irq_stats has the per line breakdown
+KCOUNTER(irqs, "irq.total");
+KCOUNTER(irqs_spurious, "irq.spurious");
+KCOUNTER(irqs_unhandled, "irq.unhandled");
+
+// serializes access to the controllers and the handler list between cpus
+static spin_lock_t pic_lock = SPIN_LOCK_INITIAL_VALUE;
+
+// shadow of both IMRs, irq 0 in bit 0
+static uint16_t irq_mask = 0xffff;
+
+// the irqs have been moved over to the io apic, the 8259s are fully masked
+// and eois go to the local apic
+static bool use_ioapic;
 
 // arguments:
 //     offset1 - vector offset for master PIC
@@ -91,48 +133,229 @@ void pic_init(void) {
     pic_remap(0x20, 0x28);
 
     // mask everything
+    irq_mask = 0xffff;
     outp(PIC1_DATA, 0xff);
     outp(PIC2_DATA, 0xff);
 }
 
+void pic_switch_to_ioapic(void) {
+    if (!ioapic_init()) {
+        return;
+    }
+
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&pic_lock, &state);
+
+    // mask the 8259s for good, but leave the vectors they were given in place
+    // in case one raises a spurious irq on the way out
+    outp(PIC1_DATA, 0xff);
+    outp(PIC2_DATA, 0xff);
+
+    // the irqs keep the vectors they had on the 8259s and all go to the boot
+    // cpu. the cascade is not a real line on the io apic, and is often where
+    // the PIT is wired instead.
+    uint8_t apic_id = lapic_get_id();
+    for (unsigned int irq = 0; irq < NUM_IRQS; irq++) {
+        if (irq == IRQ_CASCADE) {
+            continue;
+        }
+        ioapic_route_isa_irq(irq, 0x20 + irq, apic_id);
+        if (!(irq_mask & (1 << irq))) {
+            ioapic_set_isa_mask(irq, false);
+        }
+    }
+
+    use_ioapic = true;
+
+    spin_unlock_irqrestore(&pic_lock, state);
+
+    printf("PIC: irqs routed through the io apic\n");
+}
+
 void pic_set_mask(unsigned char irq, bool set) {
-    uint16_t port;
-    if (irq < 8) {
-        port = PIC1_DATA;
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&pic_lock, &state);
+
+    if (set) {
+        irq_mask |= (1 << irq);
     } else {
-        port = PIC2_DATA;
-        irq -= 8;
+        irq_mask &= ~(1 << irq);
     }
 
-    uint8_t val = inp(port);
-    if (set) {
-        val |= (1 << irq);
+    // only the controller that owns the irq needs to be touched
+    if (use_ioapic) {
+        if (irq != IRQ_CASCADE) {
+            ioapic_set_isa_mask(irq, set);
+        }
+    } else if (irq < 8) {
+        outp(PIC1_DATA, irq_mask & 0xff);
     } else {
-        val &= ~(1 << irq);
+        outp(PIC2_DATA, irq_mask >> 8);
     }
-    outp(port, val);
+
+    spin_unlock_irqrestore(&pic_lock, state);
 }
 
 void pic_send_eoi(unsigned char irq) {
+    // a single write to the local apic, no need for the lock
+    if (use_ioapic) {
+        lapic_send_eoi();
+        return;
+    }
+
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&pic_lock, &state);
+
     if (irq >= 8) {
         outp(PIC2_CMD, PIC_EOI);
     }
 
     outp(PIC1_CMD, PIC_EOI);
+
+    spin_unlock_irqrestore(&pic_lock, state);
 }
 
-// general top level irq routine for IRQs in the PIC range
-void pic_irq(unsigned int vector) {
-    pic_send_eoi(vector);
-    switch (vector) {
-        case IRQ_PIT:
-            pit_irq();
-            break;
-        case IRQ_KEYBOARD:
-            keyboard_irq();
-            break;
-        default:
-            printf("unhandled PIC interrupt\n");
+// read back a pair of registers selected with a command word, irq 0 in bit 0
+static uint16_t pic_read_reg(uint8_t cmd) {
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&pic_lock, &state);
+
+    outp(PIC1_CMD, cmd);
+    outp(PIC2_CMD, cmd);
+    uint16_t val = (inp(PIC2_CMD) << 8) | inp(PIC1_CMD);
+
+    spin_unlock_irqrestore(&pic_lock, state);
+
+    return val;
+}
+
+// return the combined interrupt request register of both PICs, irq 0 in bit 0.
+// the masked 8259s would report every line as pending once the io apic has
+// taken over, so that reads the irr of the local apic the irqs go to instead.
+uint16_t pic_get_irr(void) {
+    if (use_ioapic) {
+        return lapic_get_irr(0x20) & 0xffff;
+    }
+    return pic_read_reg(PIC_READ_IRR);
+}
+
+// same for the in service register
+uint16_t pic_get_isr(void) {
+    return pic_read_reg(PIC_READ_ISR);
+}
+
+int register_irq_handler(unsigned int irq, irq_handler_t handler, void *arg) {
+    if (irq >= NUM_IRQS || !handler) {
+        return -1;
+    }
+
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&pic_lock, &state);
+
+    // handlers come out of a fixed pool, since drivers register before the heap is up
+    struct irq_handler *h = NULL;
+    for (size_t i = 0; i < countof(handler_pool); i++) {
+        if (!handler_pool[i].handler) {
+            h = &handler_pool[i];
             break;
+        }
+    }
+
+    if (!h) {
+        spin_unlock_irqrestore(&pic_lock, state);
+        return -1;
+    }
+
+    // append, so handlers on a shared line run in registration order
+    h->handler = handler;
+    h->arg = arg;
+    h->next = NULL;
+
+    struct irq_handler **prev = &irq_handlers[irq];
+    while (*prev) {
+        prev = &(*prev)->next;
+    }
+    *prev = h;
+
+    spin_unlock_irqrestore(&pic_lock, state);
+
+    return 0;
+}
+
+// an irq 7 or 15 with the corresponding ISR bit clear was a glitch on the line
+// and the PIC did not actually consider it in service
+static bool pic_is_spurious(unsigned int irq) {
+    if (use_ioapic || (irq != 7 && irq != 15)) {
+        return false;
+    }
+
+    if (pic_get_isr() & (1 << irq)) {
+        return false;
+    }
+
+    // the master did see a real irq on the cascade line, so it still needs an eoi
+    if (irq == 15) {
+        outp(PIC1_CMD, PIC_EOI);
+    }
+
+    return true;
+}
+
+// general top level irq routine for IRQs in the PIC range
+void pic_irq(unsigned int irq) {
+    struct irq_stats *stats = &irq_stats[irq];
+
+    if (pic_is_spurious(irq)) {
+        stats->spurious++;
+        kcounter_add(irqs_spurious, 1);
+        return;
+    }
+
+    pic_send_eoi(irq);
+
+    stats->count++;
+    kcounter_add(irqs, 1);
+
+    struct irq_handler *h = irq_handlers[irq];
+    if (!h) {
+        // nobody is going to service the device, keep it from storming
+        kcounter_add(irqs_unhandled, 1);
+        printf("unhandled PIC interrupt %u, masking\n", irq);
+        pic_set_mask(irq, true);
+        return;
+    }
+
+    KTRACE_BEGIN(irq, irq, 0);
+    uint64_t start = current_time_ns();
+    for (; h; h = h->next) {
+        h->handler(h->arg);
+    }
+    stats->time_ns += current_time_ns() - start;
+    KTRACE_END(irq, irq, 0);
+}
+
+void pic_dump_stats(void) {
+    for (unsigned int irq = 0; irq < NUM_IRQS; irq++) {
+        const struct irq_stats *stats = &irq_stats[irq];
+
+        // copy out a consistent set, including the 64 bit counter, with
+        // respect to the irq, which may be running on another cpu
+        enter_critical_section();
+        uint32_t count = stats->count;
+        uint32_t spurious = stats->spurious;
+        uint64_t time_ns = stats->time_ns;
+        exit_critical_section();
+
+        if (count == 0 && spurious == 0) {
+            continue;
+        }
+
+        // a line that only ever saw spurious irqs has no average
+        uint32_t time_us = time_ns / 1000;
+        printf("irq %2u: count %8lu spurious %4lu time %8lu us", irq, count, spurious, time_us);
+        if (count != 0) {
+            printf(" avg %lu us", time_us / count);
+        }
+        printf("\n");
     }
 }
@@ -22,8 +22,13 @@
  */
 #include <hw/pit.h>
 
+#include <boot_params.h>
+#include <irqsoff.h>
+#include <spinlock.h>
 #include <stdio.h>
 #include <time.h>
+#include <timer.h>
+#include <hw/lapic.h>
 #include <hw/pc.h>
 #include <hw/pic.h>
 #include <x86/x86.h>
@@ -35,30 +40,75 @@
 #define PIT_DATA2       (0x42)  // PC speaker
 #define PIT_CMD         (0x43)  // command register
 
-#define PIT_FREQ        1193182 // input frequency in Hz
-#define PIT_HZ          100     // tick rate we desire
-#define PIT_COUNTDOWN   11932   // PIT_FREQ / PIT_HZ rounded up
+// guards the counter latch and timer_ticks against the other cpus
+static spin_lock_t pit_lock = SPIN_LOCK_INITIAL_VALUE;
 
 static uint32_t timer_ticks;
+static bool pit_running;
+static uint16_t pit_countdown;
+static uint32_t pit_hz;
+
+static void pit_irq(void *arg);
 
 uint16_t pit_read_count(void) {
     uint16_t val;
 
-    x86_flags_t flags = x86_irq_disable();
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&pit_lock, &state);
 
     outp(PIT_CMD, (0 << 6)); // latch channel 0
     val = inp(PIT_DATA0);
     val |= inp(PIT_DATA0) << 8;
 
-    x86_irq_restore(flags);
+    spin_unlock_irqrestore(&pit_lock, state);
 
     return val;
 }
 
+bool pit_is_running(void) {
+    return pit_running;
+}
+
+uint16_t pit_get_countdown(void) {
+    return pit_countdown;
+}
+
+uint64_t pit_read_clocks(void) {
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&pit_lock, &state);
+
+    uint32_t ticks = timer_ticks;
+
+    outp(PIT_CMD, (0 << 6)); // latch channel 0
+    uint16_t count = inp(PIT_DATA0);
+    count |= inp(PIT_DATA0) << 8;
+
+    // the counter may have reloaded without pit_irq() having run yet, either because
+    // irqs are disabled or because it raced with the latch above. a pending irq with
+    // a count in the top half of the period means a reload recently happened that is
+    // not yet reflected in timer_ticks. a pending irq with a low count is ambiguous,
+    // most likely the reload happened just after the latch, so leave it alone.
+    if ((pic_get_irr() & (1 << IRQ_PIT)) && count > pit_countdown / 2) {
+        ticks++;
+    }
+
+    spin_unlock_irqrestore(&pit_lock, state);
+
+    return (uint64_t)ticks * pit_countdown + (pit_countdown - count);
+}
+
 void pit_init(void) {
-    x86_flags_t flags = x86_irq_disable();
+    pit_hz = boot_param_uint("pit.hz", PIT_HZ);
+    if (pit_hz < PIT_HZ_MIN || pit_hz > PIT_HZ_MAX) {
+        printf("PIT: pit.hz %lu out of range, using %u\n", pit_hz, PIT_HZ);
+        pit_hz = PIT_HZ;
+    }
+    pit_countdown = (PIT_FREQ + pit_hz - 1) / pit_hz;
 
-    // initialize channel 0 to 100Hz continuous countdown using mode 2
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&pit_lock, &state);
+
+    // initialize channel 0 to a continuous countdown using mode 2
     uint8_t val;
     val = (0 << 6) | // channel 0
           (3 << 4) | // access mode lobyte/hibyte
@@ -67,23 +117,35 @@ void pit_init(void) {
     outp(PIT_CMD, val);
 
     // compute the countdown value and reload the reload register
-    outp(PIT_DATA0, (uint8_t)PIT_COUNTDOWN);
-    outp(PIT_DATA0, PIT_COUNTDOWN >> 8);
+    outp(PIT_DATA0, (uint8_t)pit_countdown);
+    outp(PIT_DATA0, pit_countdown >> 8);
 
     // eoi and unmask the timer irq
+    register_irq_handler(IRQ_PIT, &pit_irq, NULL);
     pic_send_eoi(IRQ_PIT);
     pic_set_mask(IRQ_PIT, false);
 
-    x86_irq_restore(flags);
+    pit_running = true;
+
+    spin_unlock_irqrestore(&pit_lock, state);
 
-    printf("PIT started at %u Hz\n", PIT_HZ);
+    printf("PIT started at %lu Hz\n", pit_hz);
 }
 
-// ticks at 100Hz
-void pit_irq(void) {
+// ticks at pit_hz, 100Hz by default
+static void pit_irq(void *arg) {
+    if (IRQSOFF_TRACE) {
+        // the counter reloaded at the moment the irq was raised, so however far it
+        // has counted down since is how long it took to get here
+        irqsoff_pit_latency(pit_countdown - pit_read_count());
+    }
+
+    spin_lock(&pit_lock);
     timer_ticks++;
-}
+    spin_unlock(&pit_lock);
 
-uint32_t current_time(void) {
-    return timer_ticks * 10; // time in ms
+    // with a local apic timer the PIT only keeps time
+    if (!lapic_timer_running()) {
+        timer_tick(current_time());
+    }
 }
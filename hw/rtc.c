@@ -0,0 +1,245 @@
+/*
+ * Copyright (c) 2019 Travis Geiselbrecht
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <hw/rtc.h>
+
+#include <spinlock.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <hw/pc.h>
+#include <hw/pic.h>
+#include <x86/x86.h>
+
+// driver for the mc146818 compatible real time clock in the cmos
+
+#define CMOS_INDEX      (0x70)
+#define CMOS_DATA       (0x71)
+
+#define RTC_SEC         0x00
+#define RTC_MIN         0x02
+#define RTC_HOUR        0x04
+#define RTC_DAY         0x07
+#define RTC_MONTH       0x08
+#define RTC_YEAR        0x09
+#define RTC_REG_A       0x0a
+#define RTC_REG_B       0x0b
+#define RTC_REG_C       0x0c
+#define RTC_CENTURY     0x32    // not standard, but present on every pc bios we care about
+
+#define RTC_A_UIP       0x80    // update in progress
+#define RTC_A_RATE_MASK 0x0f
+
+#define RTC_B_24H       0x02
+#define RTC_B_BINARY    0x04
+#define RTC_B_PIE       0x40    // periodic interrupt enable
+
+#define RTC_HOUR_PM     0x80    // in 12 hour mode
+
+#define RTC_BASE_FREQ   32768U
+
+// pairs up the index and data accesses across cpus, and guards the callback
+static spin_lock_t rtc_lock = SPIN_LOCK_INITIAL_VALUE;
+
+static rtc_callback_t periodic_callback;
+static void *periodic_arg;
+static uint32_t periodic_count;
+
+static void rtc_irq(void *arg);
+
+// callers must hold rtc_lock with irqs disabled, since the index and data accesses must be paired
+static uint8_t cmos_read(uint8_t reg) {
+    outp(CMOS_INDEX, reg);
+    return inp(CMOS_DATA);
+}
+
+static void cmos_write(uint8_t reg, uint8_t val) {
+    outp(CMOS_INDEX, reg);
+    outp(CMOS_DATA, val);
+}
+
+static uint8_t bcd_to_bin(uint8_t val) {
+    return (val & 0xf) + (val >> 4) * 10;
+}
+
+static void rtc_read_raw(struct rtc_time *t, uint8_t *century) {
+    // wait for any update cycle to finish, after which there are at least 244us
+    // before the next one starts
+    while (cmos_read(RTC_REG_A) & RTC_A_UIP) {
+    }
+
+    t->sec = cmos_read(RTC_SEC);
+    t->min = cmos_read(RTC_MIN);
+    t->hour = cmos_read(RTC_HOUR);
+    t->day = cmos_read(RTC_DAY);
+    t->month = cmos_read(RTC_MONTH);
+    t->year = cmos_read(RTC_YEAR);
+    *century = cmos_read(RTC_CENTURY);
+}
+
+void rtc_read_time(struct rtc_time *t) {
+    struct rtc_time last;
+    uint8_t century, last_century;
+
+    // read until two passes agree, in case an update started part way through
+    // (or the lock was briefly dropped between passes and we missed the window)
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&rtc_lock, &state);
+    rtc_read_raw(t, &century);
+    do {
+        last = *t;
+        last_century = century;
+        spin_unlock_irqrestore(&rtc_lock, state);
+        spin_lock_irqsave(&rtc_lock, &state);
+        rtc_read_raw(t, &century);
+    } while (last.sec != t->sec || last.min != t->min || last.hour != t->hour ||
+             last.day != t->day || last.month != t->month || last.year != t->year ||
+             last_century != century);
+
+    uint8_t regb = cmos_read(RTC_REG_B);
+    spin_unlock_irqrestore(&rtc_lock, state);
+
+    bool pm = t->hour & RTC_HOUR_PM;
+    t->hour &= ~RTC_HOUR_PM;
+
+    if (!(regb & RTC_B_BINARY)) {
+        t->sec = bcd_to_bin(t->sec);
+        t->min = bcd_to_bin(t->min);
+        t->hour = bcd_to_bin(t->hour);
+        t->day = bcd_to_bin(t->day);
+        t->month = bcd_to_bin(t->month);
+        t->year = bcd_to_bin(t->year);
+        century = bcd_to_bin(century);
+    }
+
+    if (!(regb & RTC_B_24H)) {
+        // 12 is midnight or noon
+        t->hour %= 12;
+        if (pm) {
+            t->hour += 12;
+        }
+    }
+
+    // a missing century register reads as 0 or garbage, so guess
+    if (century >= 19 && century <= 99) {
+        t->year += century * 100;
+    } else {
+        t->year += (t->year < 70) ? 2000 : 1900;
+    }
+}
+
+uint32_t rtc_time_to_unix(const struct rtc_time *t) {
+    static const uint16_t days_before_month[12] = {
+        0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334
+    };
+
+    uint32_t year = t->year;
+    uint32_t days = (year - 1970) * 365;
+
+    // leap days in the years before this one
+    days += (year - 1969) / 4 - (year - 1901) / 100 + (year - 1601) / 400;
+
+    days += days_before_month[(t->month - 1) % 12] + t->day - 1;
+    bool leap = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+    if (leap && t->month > 2) {
+        days++;
+    }
+
+    return ((days * 24 + t->hour) * 60 + t->min) * 60 + t->sec;
+}
+
+int rtc_start_periodic(uint32_t hz, rtc_callback_t callback, void *arg) {
+    if (hz < 2 || hz > 8192 || (hz & (hz - 1))) {
+        return -1;
+    }
+
+    // rate n gives RTC_BASE_FREQ >> (n - 1)
+    uint8_t rate = 1;
+    while ((RTC_BASE_FREQ >> (rate - 1)) != hz) {
+        rate++;
+    }
+
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&rtc_lock, &state);
+
+    periodic_callback = callback;
+    periodic_arg = arg;
+
+    cmos_write(RTC_REG_A, (cmos_read(RTC_REG_A) & ~RTC_A_RATE_MASK) | rate);
+    cmos_write(RTC_REG_B, cmos_read(RTC_REG_B) | RTC_B_PIE);
+
+    // clear any stale flags so the irq line is released
+    cmos_read(RTC_REG_C);
+
+    // the rtc is on the slave pic, so the cascade needs to be open too
+    pic_send_eoi(IRQ_RTC);
+    pic_set_mask(IRQ_CASCADE, false);
+    pic_set_mask(IRQ_RTC, false);
+
+    spin_unlock_irqrestore(&rtc_lock, state);
+
+    return 0;
+}
+
+void rtc_stop_periodic(void) {
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&rtc_lock, &state);
+
+    pic_set_mask(IRQ_RTC, true);
+    cmos_write(RTC_REG_B, cmos_read(RTC_REG_B) & ~RTC_B_PIE);
+    cmos_read(RTC_REG_C);
+
+    periodic_callback = NULL;
+    periodic_arg = NULL;
+
+    spin_unlock_irqrestore(&rtc_lock, state);
+}
+
+uint32_t rtc_periodic_count(void) {
+    return periodic_count;
+}
+
+static void rtc_irq(void *arg) {
+    spin_lock(&rtc_lock);
+
+    // reading C acknowledges the interrupt, without this no more will be raised
+    cmos_read(RTC_REG_C);
+
+    periodic_count++;
+    rtc_callback_t callback = periodic_callback;
+    void *callback_arg = periodic_arg;
+
+    spin_unlock(&rtc_lock);
+
+    if (callback) {
+        callback(callback_arg);
+    }
+}
+
+void rtc_init(void) {
+    register_irq_handler(IRQ_RTC, &rtc_irq, NULL);
+
+    struct rtc_time t;
+    rtc_read_time(&t);
+
+    printf("RTC: %04u-%02u-%02u %02u:%02u:%02u (unix %lu)\n", t.year, t.month, t.day,
+           t.hour, t.min, t.sec, rtc_time_to_unix(&t));
+}
@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2019 Travis Geiselbrecht
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <hw/uart.h>
+
+#include <console.h>
+#include <stdbool.h>
+#include <hw/pc.h>
+#include <hw/pic.h>
+#include <x86/x86.h>
+
+// driver for the 8250/16550 uart on the first legacy serial port
+
+#define UART_BASE       (0x3f8)
+
+#define UART_RBR        (UART_BASE + 0) // receive buffer (read, DLAB = 0)
+#define UART_THR        (UART_BASE + 0) // transmit holding (write, DLAB = 0)
+#define UART_DLL        (UART_BASE + 0) // divisor latch low (DLAB = 1)
+#define UART_IER        (UART_BASE + 1) // interrupt enable (DLAB = 0)
+#define UART_DLM        (UART_BASE + 1) // divisor latch high (DLAB = 1)
+#define UART_FCR        (UART_BASE + 2) // fifo control (write)
+#define UART_LCR        (UART_BASE + 3) // line control
+#define UART_MCR        (UART_BASE + 4) // modem control
+#define UART_LSR        (UART_BASE + 5) // line status
+#define UART_SCR        (UART_BASE + 7) // scratch
+
+#define UART_IER_RDA    0x01            // received data available
+
+#define UART_LCR_8N1    0x03
+#define UART_LCR_DLAB   0x80
+
+#define UART_LSR_DR     0x01            // data ready
+#define UART_LSR_THRE   0x20            // transmit holding register empty
+
+// the most characters that can be waiting, on a 16550 with its fifo enabled
+#define UART_FIFO_DEPTH 16
+
+#define UART_CLOCK      115200
+#define UART_BAUD       115200
+
+static bool uart_present;
+
+static void uart_irq(void *arg);
+
+// a missing uart floats the bus, so the scratch register won't hold a value
+static bool uart_probe(void) {
+    outp(UART_SCR, 0x5a);
+    if (inp(UART_SCR) != 0x5a) {
+        return false;
+    }
+    outp(UART_SCR, 0xa5);
+    return inp(UART_SCR) == 0xa5;
+}
+
+// read out whatever is waiting, stopping after a fifo's worth in case the
+// line status never clears
+static void uart_drain(bool to_console) {
+    for (int i = 0; i < UART_FIFO_DEPTH && (inp(UART_LSR) & UART_LSR_DR); i++) {
+        char c = inp(UART_RBR);
+        if (to_console) {
+            console_input(c);
+        }
+    }
+}
+
+void uart_init(void) {
+    uart_present = uart_probe();
+
+    // no interrupts for now
+    outp(UART_IER, 0);
+
+    // program the baud rate divisor
+    uint16_t divisor = UART_CLOCK / UART_BAUD;
+    outp(UART_LCR, UART_LCR_DLAB);
+    outp(UART_DLL, divisor & 0xff);
+    outp(UART_DLM, divisor >> 8);
+    outp(UART_LCR, UART_LCR_8N1);
+
+    // enable and clear the fifos, if present
+    outp(UART_FCR, 0xc7);
+
+    // raise DTR and RTS, enable OUT2 so the irq line is driven
+    outp(UART_MCR, 0x0b);
+}
+
+void uart_putchar(char c) {
+    // a missing uart reads back as all ones, so this won't hang
+    while ((inp(UART_LSR) & UART_LSR_THRE) == 0) {
+    }
+
+    outp(UART_THR, c);
+}
+
+// route received characters to the console
+void uart_init_irq(void) {
+    if (!uart_present) {
+        return;
+    }
+
+    // drain anything left over from before
+    uart_drain(false);
+
+    outp(UART_IER, UART_IER_RDA);
+
+    // unmask the uart irq
+    register_irq_handler(IRQ_COM1, &uart_irq, NULL);
+    pic_set_mask(IRQ_COM1, false);
+}
+
+static void uart_irq(void *arg) {
+    uart_drain(true);
+}
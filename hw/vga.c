@@ -24,6 +24,7 @@
 
 #include <ctype.h>
 #include <console.h>
+#include <kcounter.h>
 #include <string.h>
 #include <stdlib.h>
 #include <x86/x86.h>
@@ -37,6 +38,8 @@ static unsigned line = 0;
 #define SCREEN_WIDTH 80
 #define SCREEN_HEIGHT 25
 
+KCOUNTER(vga_scrolls, "vga.scroll");
+
 void vga_console_init(bool clear) {
     // disable the cursor
     outp(0x3d4, 0x0a);
@@ -52,6 +55,8 @@ void vga_console_init(bool clear) {
 // scroll the screen by copying line 1-24 to line 0-23
 // and then clearing the last line
 static void vga_console_scrup(void) {
+    kcounter_add(vga_scrolls, 1);
+
     memcpy(vga, vga + SCREEN_WIDTH, (SCREEN_HEIGHT - 1) * SCREEN_WIDTH * 2);
     for (int i = 0; i < SCREEN_WIDTH; i++) {
         vga[(SCREEN_HEIGHT - 1) * SCREEN_WIDTH + i] = 0x720;
@@ -69,6 +74,11 @@ void vga_console_putchar(char c) {
         case '\t':
             col = ROUNDUP(col + 1, 4);
             break;
+        case '\b':
+            if (col > 0) {
+                col--;
+            }
+            break;
         default:
             if (isprint(c)) {
                 vga[line * SCREEN_WIDTH + col] = 0xf00 | (c & 0x7f);
@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2019 Travis Geiselbrecht
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#pragma once
+
+#include <compiler.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <x86/cpu.h>
+#include <x86/x86.h>
+
+// atomic operations on 32 bit words, all acting as full barriers.
+// add and xchg are atomic on any cpu. xadd and cmpxchg arrived with the 486,
+// so on a 386 fetch_add and cmpxchg fall back to disabling irqs around a plain
+// read-modify-write, which is enough there since no 386 runs more than one cpu.
+
+static inline uint32_t atomic_load(volatile uint32_t *ptr) {
+    uint32_t val = *ptr;
+    __asm__ volatile("" ::: "memory");
+    return val;
+}
+
+static inline void atomic_store(volatile uint32_t *ptr, uint32_t val) {
+    __asm__ volatile("" ::: "memory");
+    *ptr = val;
+}
+
+static inline void atomic_add(volatile uint32_t *ptr, uint32_t val) {
+    __asm__ volatile("lock addl %1, %0"
+                     : "+m" (*ptr)
+                     : "ir" (val)
+                     : "memory", "cc");
+}
+
+// store val and return the old value
+static inline uint32_t atomic_xchg(volatile uint32_t *ptr, uint32_t val) {
+    __asm__ volatile("xchgl %0, %1"
+                     : "+r" (val), "+m" (*ptr)
+                     :: "memory");
+    return val;
+}
+
+// add val and return the old value
+static inline uint32_t atomic_fetch_add(volatile uint32_t *ptr, uint32_t val) {
+    if (likely(x86_feature_test(X86_FEATURE_486))) {
+        __asm__ volatile("lock xaddl %0, %1"
+                         : "+r" (val), "+m" (*ptr)
+                         :: "memory", "cc");
+        return val;
+    }
+
+    x86_flags_t flags = x86_irq_disable();
+    uint32_t old = *ptr;
+    *ptr = old + val;
+    x86_irq_restore(flags);
+    return old;
+}
+
+// store newval if *ptr is oldval. returns what *ptr held, so it succeeded if
+// that is oldval.
+static inline uint32_t atomic_cmpxchg(volatile uint32_t *ptr, uint32_t oldval, uint32_t newval) {
+    if (likely(x86_feature_test(X86_FEATURE_486))) {
+        __asm__ volatile("lock cmpxchgl %2, %1"
+                         : "+a" (oldval), "+m" (*ptr)
+                         : "r" (newval)
+                         : "memory", "cc");
+        return oldval;
+    }
+
+    x86_flags_t flags = x86_irq_disable();
+    uint32_t cur = *ptr;
+    if (cur == oldval) {
+        *ptr = newval;
+    }
+    x86_irq_restore(flags);
+    return cur;
+}
+
+// tell the cpu it is in a spin loop. rep nop is pause on a pentium 4 and
+// later and a plain nop before that.
+static inline void arch_spin_pause(void) {
+    __asm__ volatile("rep; nop" ::: "memory");
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2019 Travis Geiselbrecht
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#pragma once
+
+// layout shared between the kernel, the decompressor stub and makeflop
+
+// with a compressed image, makeflop emits the stub binary followed by this
+// header and the lzss stream. the stub is linked at STUB_BASE and moves itself
+// and the payload up there before decompressing the kernel to KERNEL_LOAD_BASE.
+#define KERNEL_LOAD_BASE        0x100000
+#define STUB_BASE               0x180000
+
+#define BOOT_IMAGE_LZSS_MAGIC   0x53535a4c  // 'LZSS'
+
+// lzss stream: a flag byte, lsb first, covers the next 8 items. a set bit is a
+// literal byte, a clear bit is a 16 bit little endian match with the distance
+// back minus one in the low 12 bits and the length minus LZSS_MIN_MATCH in the
+// top 4.
+#define LZSS_WINDOW             4096
+#define LZSS_MIN_MATCH          3
+#define LZSS_MAX_MATCH          (LZSS_MIN_MATCH + 15)
+
+// offset into the kernel image of struct boot_image_info, just past the
+// jump at _start. the stub fills it in after decompressing.
+#define BOOT_IMAGE_INFO_OFFSET  4
+
+#ifndef __ASSEMBLER__
+
+#include <stdint.h>
+
+struct lzss_header {
+    uint32_t magic;
+    uint32_t compressed_size;
+    uint32_t uncompressed_size;
+};
+
+struct boot_image_info {
+    uint32_t compressed_size;       // zero if the kernel was loaded uncompressed
+    uint32_t uncompressed_size;
+    uint32_t decompress_clocks;     // PIT clocks spent decompressing
+};
+
+extern struct boot_image_info boot_image_info;
+
+#endif
@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2019 Travis Geiselbrecht
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#pragma once
+
+// boot parameters: a versioned block at the end of the bootblock holding a
+// key=value command line. makeflop patches it into the image and the bootblock
+// hands its address to the kernel, so one image can be run with different
+// settings. the multiboot entry fills one in from the multiboot command line.
+#define BOOT_PARAMS_MAGIC       0x4d525042  // 'BPRM'
+#define BOOT_PARAMS_VERSION     1
+#define BOOT_PARAMS_SIZE        128
+#define BOOT_PARAMS_OFFSET      (1024 - BOOT_PARAMS_SIZE)  // within the bootblock
+#define BOOT_PARAMS_CMDLINE_LEN (BOOT_PARAMS_SIZE - 8)
+
+#ifndef __ASSEMBLER__
+
+#include <stdint.h>
+
+struct boot_params {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t size;          // of the whole block
+    char cmdline[BOOT_PARAMS_CMDLINE_LEN];  // space separated key=value, nul terminated
+};
+
+// copy and split the command line out of the block, ignoring a missing or
+// mismatched one
+void boot_params_init(const struct boot_params *params);
+
+// value of key, or NULL if it wasn't given
+const char *boot_param_get(const char *key);
+
+// value of key as an unsigned number, decimal or 0x hex with an optional
+// k or m suffix, or def if it wasn't given, doesn't parse or doesn't fit
+uint32_t boot_param_uint(const char *key, uint32_t def);
+
+void boot_params_dump(void);
+
+#endif
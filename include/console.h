@@ -31,6 +31,11 @@ void console_init(void);
 // return number of characters written
 int console_write(const char *str, size_t len, bool crlf);
 
-// input from the the user via an input device
+// input from the the user via an input device, called with interrupts disabled
 void console_input(char c);
 
+// read at most len chars of input, up to and including the end of the line.
+// blocks until a line has been entered.
+// return number of characters read
+int console_read(char *buf, size_t len);
+
@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2019 Travis Geiselbrecht
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <hw/pc.h>
+
+// busy wait delays, calibrated at boot against the PIT
+
+// run through a calibrated spin loop a number of times
+static inline void delay_loop(uint32_t loops) {
+    if (loops == 0) {
+        return;
+    }
+    __asm__ volatile(
+        "0:;"
+        "dec %0;"
+        "jnz 0b"
+        : "+r"(loops) :: "cc");
+}
+
+// loops per microsecond, in 16.16 fixed point
+extern uint32_t delay_loops_per_us;
+
+static inline void udelay(uint32_t us) {
+    delay_loop(((uint64_t)us * delay_loops_per_us) >> 16);
+}
+
+static inline void mdelay(uint32_t ms) {
+    while (ms--) {
+        udelay(1000);
+    }
+}
+
+// delay for roughly n microseconds by writing to an unused port. the isa bus
+// makes each write take about a microsecond regardless of cpu speed, which makes
+// it usable before calibration and for the short settle times old chips need.
+static inline void io_delay(uint32_t n) {
+    while (n--) {
+        io_wait();
+    }
+}
+
+// spin until cond is true or timeout_us microseconds have passed.
+// evaluates to the final value of cond.
+#define spin_until(cond, timeout_us) ({ \
+    uint32_t __timeout = (timeout_us); \
+    bool __done; \
+    while (!(__done = (cond)) && __timeout > 0) { \
+        udelay(1); \
+        __timeout--; \
+    } \
+    __done; \
+})
+
+// measure the speed of delay_loop() against the PIT. must be called after the
+// PIT has been started and with interrupts disabled.
+void delay_calibrate(void);
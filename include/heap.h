@@ -35,7 +35,8 @@ void *calloc(size_t count, size_t size) __MALLOC;
 void *realloc(void *ptr, size_t size) __MALLOC;
 void free(void *ptr);
 
-void heap_init(void);
+// mem_top is the end of the ram the kernel was loaded into, or 0 if unknown
+void heap_init(uintptr_t mem_top);
 void heap_dump(void);
 
 __END_CDECLS
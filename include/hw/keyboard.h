@@ -22,6 +22,71 @@
  */
 #pragma once
 
+// key codes passed to listeners. keys with an ascii meaning use it, everything
+// else is numbered above the ascii range.
+#define KEY_ESC         0x1b
+
+#define KEY_F1          0x100
+#define KEY_F2          0x101
+#define KEY_F3          0x102
+#define KEY_F4          0x103
+#define KEY_F5          0x104
+#define KEY_F6          0x105
+#define KEY_F7          0x106
+#define KEY_F8          0x107
+#define KEY_F9          0x108
+#define KEY_F10         0x109
+#define KEY_F11         0x10a
+#define KEY_F12         0x10b
+
+#define KEY_UP          0x110
+#define KEY_DOWN        0x111
+#define KEY_LEFT        0x112
+#define KEY_RIGHT       0x113
+#define KEY_HOME        0x114
+#define KEY_END         0x115
+#define KEY_PGUP        0x116
+#define KEY_PGDN        0x117
+#define KEY_INS         0x118
+#define KEY_DEL         0x119
+
+#define KEY_LSHIFT      0x120
+#define KEY_RSHIFT      0x121
+#define KEY_LCTRL       0x122
+#define KEY_RCTRL       0x123
+#define KEY_LALT        0x124
+#define KEY_RALT        0x125
+#define KEY_LGUI        0x126
+#define KEY_RGUI        0x127
+#define KEY_MENU        0x128
+#define KEY_CAPSLOCK    0x129
+#define KEY_NUMLOCK     0x12a
+#define KEY_SCROLLLOCK  0x12b
+#define KEY_PRTSCR      0x12c
+#define KEY_PAUSE       0x12d
+
+// flags passed along with each key event
+#define KEY_FLAG_UP         0x0001  // key released
+#define KEY_FLAG_REPEAT     0x0002  // typematic repeat of a held key
+
+#define KEY_MOD_LSHIFT      0x0100
+#define KEY_MOD_RSHIFT      0x0200
+#define KEY_MOD_LCTRL       0x0400
+#define KEY_MOD_RCTRL       0x0800
+#define KEY_MOD_LALT        0x1000
+#define KEY_MOD_RALT        0x2000
+#define KEY_MOD_CAPSLOCK    0x4000
+#define KEY_MOD_NUMLOCK     0x8000
+#define KEY_MOD_SCROLLLOCK  0x10000
+
+#define KEY_MOD_SHIFT       (KEY_MOD_LSHIFT | KEY_MOD_RSHIFT)
+#define KEY_MOD_CTRL        (KEY_MOD_LCTRL | KEY_MOD_RCTRL)
+#define KEY_MOD_ALT         (KEY_MOD_LALT | KEY_MOD_RALT)
+
 void keyboard_init(void);
-void keyboard_irq(void);
+
+// by default key presses are fed to the console. a listener replaces that and
+// receives every press, repeat and release. called from the keyboard task.
+typedef void (*keyboard_listener_t)(int key, unsigned int flags);
+void keyboard_set_listener(keyboard_listener_t listener);
 
@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2019 Travis Geiselbrecht
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// local apic, one per cpu, at the same physical address on every cpu
+
+#define LAPIC_DEFAULT_BASE      0xfee00000
+
+// vectors the local apic delivers, above the 16 legacy irqs at 0x20.
+// the spurious vector has its low 4 bits hardwired to 1 on older parts.
+#define LAPIC_VECTOR_BASE       0x30
+#define LAPIC_VECTOR_RESCHEDULE 0x30
+#define LAPIC_VECTOR_TIMER      0x31
+#define LAPIC_VECTOR_SPURIOUS   0x3f
+#define LAPIC_VECTOR_END        0x40
+
+// set the physical address of the local apic, from the MP or ACPI tables
+void lapic_set_base(uintptr_t base);
+bool lapic_present(void);
+
+// enable the local apic of the calling cpu
+void lapic_init(bool bsp);
+
+uint32_t lapic_get_id(void);
+void lapic_send_eoi(void);
+
+// the 32 bit word of the interrupt request register that holds vector
+uint32_t lapic_get_irr(unsigned int vector);
+
+// the timer is calibrated against the PIT on the boot cpu, then started on
+// each cpu as it calls this. it runs one shot, armed for the end of the time
+// slice or the next kernel timer, whichever comes first, and once running it
+// drives timer_tick() in place of the PIT.
+void lapic_timer_init(void);
+bool lapic_timer_running(void);
+
+// a kernel timer now expires at deadline, in current_time() ms, so make sure
+// this cpu's timer fires by then
+void lapic_timer_set_deadline(uint32_t deadline);
+
+// interrupt the cpu with the given apic id
+void lapic_send_ipi(uint32_t apic_id, uint32_t vector);
+
+// the INIT, SIPI, SIPI sequence that starts an application processor in real
+// mode at entry, which must be page aligned and below 1MB. returns once the
+// ipis have been sent, the caller waits for the cpu to check in.
+void lapic_start_ap(uint32_t apic_id, uintptr_t entry);
+
+// put an application processor back into its wait for startup state
+void lapic_stop_ap(uint32_t apic_id);
+
+// called from the exception handler for vectors in [LAPIC_VECTOR_BASE, LAPIC_VECTOR_END)
+void lapic_irq(unsigned int vector);
@@ -25,6 +25,9 @@
 // common definitions for PC hardware
 #define IRQ_PIT         0
 #define IRQ_KEYBOARD    1
+#define IRQ_CASCADE     2
+#define IRQ_COM1        4
+#define IRQ_RTC         8
 
 static inline void io_wait(void) {
     // Port 0x80 is used for 'checkpoints' during POST.
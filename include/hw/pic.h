@@ -23,9 +23,28 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stdint.h>
+
+#define NUM_IRQS 16
+
+typedef void (*irq_handler_t)(void *arg);
 
 void pic_init(void);
+
+// move the irqs over to the io apic, when the MP or ACPI tables list one. the
+// rest of this interface carries on working the same on top of it.
+void pic_switch_to_ioapic(void);
 void pic_set_mask(unsigned char irq, bool set);
 void pic_send_eoi(unsigned char irq);
+uint16_t pic_get_irr(void);
+uint16_t pic_get_isr(void);
+
+// add a handler to the chain for irq, called in irq context after the eoi.
+// handlers on a shared line are all called on every interrupt.
+// the irq is not unmasked, returns -1 if out of handler slots.
+int register_irq_handler(unsigned int irq, irq_handler_t handler, void *arg);
+
+// print per irq counts and time spent in handlers
+void pic_dump_stats(void);
 
-void pic_irq(unsigned int vector);
+void pic_irq(unsigned int irq);
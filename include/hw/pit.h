@@ -22,8 +22,24 @@
  */
 #pragma once
 
+#include <stdbool.h>
 #include <stdint.h>
 
+#define PIT_FREQ        1193182 // input frequency in Hz
+#define PIT_HZ          100     // default tick rate, overridden by the pit.hz boot param
+#define PIT_HZ_MIN      19      // slowest rate the 16 bit countdown can reach
+#define PIT_HZ_MAX      10000
+
 void pit_init(void);
 
-void pit_irq(void);
+// the channel 0 reload value, PIT_FREQ / tick rate rounded up
+uint16_t pit_get_countdown(void);
+
+// true once pit_init() has run and the time routines are usable
+bool pit_is_running(void);
+
+// read the current value of the channel 0 countdown
+uint16_t pit_read_count(void);
+
+// number of PIT input clocks since pit_init(), including the partial current tick
+uint64_t pit_read_clocks(void);
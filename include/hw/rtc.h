@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2019 Travis Geiselbrecht
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#pragma once
+
+#include <stdint.h>
+
+struct rtc_time {
+    uint16_t year;      // full year, eg 2018
+    uint8_t  month;     // 1 - 12
+    uint8_t  day;       // 1 - 31
+    uint8_t  hour;      // 0 - 23
+    uint8_t  min;
+    uint8_t  sec;
+};
+
+typedef void (*rtc_callback_t)(void *arg);
+
+void rtc_init(void);
+
+// read the current date and time from the cmos clock
+void rtc_read_time(struct rtc_time *t);
+
+// seconds since 1970-01-01 00:00:00
+uint32_t rtc_time_to_unix(const struct rtc_time *t);
+
+// enable the periodic interrupt at hz, a power of two from 2 to 8192, calling
+// callback from irq context on every tick. returns -1 if the rate is invalid.
+int rtc_start_periodic(uint32_t hz, rtc_callback_t callback, void *arg);
+void rtc_stop_periodic(void);
+
+// periodic interrupts taken since boot
+uint32_t rtc_periodic_count(void);
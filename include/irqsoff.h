@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2019 Travis Geiselbrecht
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// optional tracer for time spent with irqs disabled, by critical sections,
+// x86_irq_disable() and the spinlocks that use it, and for irq entry latency.
+// build with IRQSOFF_TRACE=1 to enable, otherwise the hooks compile away.
+
+#ifndef IRQSOFF_TRACE
+#define IRQSOFF_TRACE 0
+#endif
+
+// the window open on a cpu, kept in its struct percpu
+struct irqsoff_cpu {
+    bool active;
+    uint64_t start_ns;
+    void *start_caller;
+};
+
+#if IRQSOFF_TRACE
+
+// called with irqs already disabled, by the code that disabled them and
+// by the code about to reenable them. a start with a window already open
+// on the cpu is part of that window.
+void irqsoff_start(void *caller);
+void irqsoff_stop(void *caller);
+
+// the address it was called from, for code that is inlined into its caller
+void *irqsoff_caller(void);
+
+// record how long after the PIT reload its irq handler started, in PIT clocks
+void irqsoff_pit_latency(uint32_t clocks);
+
+void irqsoff_reset(void);
+
+#else
+
+static inline void irqsoff_start(void *caller) {}
+static inline void irqsoff_stop(void *caller) {}
+static inline void irqsoff_pit_latency(uint32_t clocks) {}
+static inline void irqsoff_reset(void) {}
+
+#endif
+
+// print the longest windows and the latency stats
+void irqsoff_dump(void);
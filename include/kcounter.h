@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2019 Travis Geiselbrecht
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#pragma once
+
+#include <compiler.h>
+#include <stdint.h>
+
+// always on event counters. each KCOUNTER() puts a descriptor in the kcounters
+// section, collected by the linker script, so kcounter_dump() can find them all
+// without any registration at runtime.
+
+struct kcounter_desc {
+    const char *name;
+    uint32_t *value;
+};
+
+// define a counter at file scope. var is the C identifier, name is how it is
+// reported, by convention "subsystem.thing".
+#define KCOUNTER(var, name) \
+    static uint32_t var##_value; \
+    static const struct kcounter_desc var##_desc __SECTION("kcounters") __USED = { name, &var##_value }
+
+// a single locked add to memory, which neither an irq nor another cpu can
+// split, so this is safe from any context
+#define kcounter_add(var, n) \
+    __asm__ volatile("lock addl %1, %0" : "+m" (var##_value) : "ir" ((uint32_t)(n)) : "cc")
+
+// print every counter in the kernel
+void kcounter_dump(void);
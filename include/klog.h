@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2019 Travis Geiselbrecht
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#pragma once
+
+#include <compiler.h>
+#include <stdarg.h>
+#include <stddef.h>
+
+// in memory kernel log, in the style of dmesg.
+//
+// writers append timestamped records to a ring buffer and return immediately,
+// a dedicated task drains the ring to the console. safe to write from any
+// context, including irq handlers. when the ring overflows the oldest records
+// are dropped and counted.
+
+// start the console drain task. until this is called, writes are drained
+// synchronously by the writer.
+void klog_init(void);
+
+// append a block of text to the log, returns the number of bytes written
+int klog_write(const char *str, size_t len);
+int klog_vprintf(const char *fmt, va_list ap);
+
+// write out anything pending from the caller's context
+void klog_flush(void);
+
+// switch to synchronous output and flush anything pending, for use on the way down
+void klog_panic(void);
+
+// dump the retained log with timestamps
+void klog_dump(void);
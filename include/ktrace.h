@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2019 Travis Geiselbrecht
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#pragma once
+
+#include <compiler.h>
+#include <stdint.h>
+
+// static tracepoints. each tracepoint site gets a descriptor in the ktrace_events
+// section, collected by the linker script, and its index there is the event id.
+// records are fixed size binary and go into a ring that keeps the most recent
+// events. build with KTRACE=1 to enable, otherwise tracepoints compile away
+// without evaluating their arguments.
+
+#ifndef KTRACE
+#define KTRACE 0
+#endif
+
+struct ktrace_event {
+    const char *name;
+};
+
+// phases, matching the chrome trace event format
+#define KTRACE_PHASE_BEGIN      'B'
+#define KTRACE_PHASE_END        'E'
+#define KTRACE_PHASE_INSTANT    'i'
+
+#if KTRACE
+
+void ktrace_record(const struct ktrace_event *ev, char phase, uint32_t a, uint32_t b);
+
+#define __KTRACE(_name, phase, a, b) do { \
+    static const struct ktrace_event __ktrace_##_name __SECTION("ktrace_events") __USED = { #_name }; \
+    ktrace_record(&__ktrace_##_name, phase, (uint32_t)(a), (uint32_t)(b)); \
+} while (0)
+
+#else
+
+#define __KTRACE(_name, phase, a, b) do { } while (0)
+
+#endif
+
+#define KTRACE_BEGIN(name, a, b)    __KTRACE(name, KTRACE_PHASE_BEGIN, a, b)
+#define KTRACE_END(name, a, b)      __KTRACE(name, KTRACE_PHASE_END, a, b)
+#define KTRACE_INSTANT(name, a, b)  __KTRACE(name, KTRACE_PHASE_INSTANT, a, b)
+
+// write the event table and the retained records to the serial port in a form
+// that ktrace2json can turn into a chrome trace
+void ktrace_dump(void);
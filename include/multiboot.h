@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2019 Travis Geiselbrecht
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#pragma once
+
+// multiboot v1, enough of it to be loaded directly by qemu -kernel or grub
+
+#define MULTIBOOT_HEADER_MAGIC      0x1badb002
+#define MULTIBOOT_BOOTLOADER_MAGIC  0x2badb002
+
+// header flags
+#define MULTIBOOT_PAGE_ALIGN        (1 << 0)
+#define MULTIBOOT_MEMORY_INFO       (1 << 1)
+
+#define MULTIBOOT_HEADER_FLAGS      (MULTIBOOT_PAGE_ALIGN | MULTIBOOT_MEMORY_INFO)
+
+#ifndef __ASSEMBLER__
+
+#include <compiler.h>
+#include <stdint.h>
+
+// multiboot_info flags
+#define MULTIBOOT_INFO_MEMORY       (1 << 0)
+#define MULTIBOOT_INFO_CMDLINE      (1 << 2)
+#define MULTIBOOT_INFO_MEM_MAP      (1 << 6)
+
+struct multiboot_info {
+    uint32_t flags;
+    uint32_t mem_lower;         // KB below 1MB
+    uint32_t mem_upper;         // KB above 1MB
+    uint32_t boot_device;
+    uint32_t cmdline;
+    uint32_t mods_count;
+    uint32_t mods_addr;
+    uint32_t syms[4];
+    uint32_t mmap_length;
+    uint32_t mmap_addr;
+} __PACKED;
+
+// size does not include itself, so the next entry is at &size + size + 4
+struct multiboot_mmap_entry {
+    uint32_t size;
+    uint64_t addr;
+    uint64_t len;
+    uint32_t type;
+} __PACKED;
+
+#endif
@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2019 Travis Geiselbrecht
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#pragma once
+
+#include <irqsoff.h>
+#include <list.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <task.h>
+#include <x86/x86.h>
+
+// per cpu state. each cpu keeps a data segment based at its own entry in fs,
+// so the current cpu's entry is one load away.
+struct percpu {
+    struct percpu *self;        // must be first, percpu_get() loads it from fs:0
+    uint32_t cpu_num;
+    uint32_t apic_id;
+
+    task_t *current_task;
+    struct list_node run_queue;
+    bool need_resched;
+
+    struct x86_iframe *irq_frame;   // of the irq being handled, irqs don't nest
+    struct irqsoff_cpu irqsoff;
+
+    task_t idle_task;
+    struct x86_tss tss;
+};
+
+extern struct percpu percpu[SMP_MAX_CPUS];
+
+// number of cpus running, cpu numbers are [0, smp_cpu_count)
+extern uint32_t smp_cpu_count;
+
+static inline struct percpu *percpu_get(void) {
+    struct percpu *p;
+    __asm__ volatile("movl %%fs:0, %0" : "=r" (p));
+    return p;
+}
+
+static inline uint32_t smp_cpu_num(void) {
+    return percpu_get()->cpu_num;
+}
+
+// point this cpu's fs at its percpu entry and load its tss
+void percpu_init(uint32_t cpu_num);
+
+// find the other cpus and start them, each comes up into its idle task. with
+// a local apic, the irqs move to the io apic and each cpu runs its apic timer.
+// a no-op without an MP or ACPI table, leaving the 8259s and the PIT in charge.
+void smp_init(void);
+
+// make a cpu run its scheduler, through an ipi if it isn't the current one
+void smp_reschedule(uint32_t cpu_num);
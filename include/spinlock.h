@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2019 Travis Geiselbrecht
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#pragma once
+
+#include <atomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <x86/x86.h>
+
+// ticket spinlocks: each locker takes the next ticket and waits for owner to
+// reach it, so waiters get the lock in the order they arrived.
+//
+// spin_lock() leaves irqs alone. a lock that an irq handler also takes must
+// be held with spin_lock_irqsave(), or the handler can spin on a lock its
+// own cpu holds.
+typedef struct spin_lock {
+    volatile uint32_t next;
+    volatile uint32_t owner;
+} spin_lock_t;
+
+#define SPIN_LOCK_INITIAL_VALUE { 0, 0 }
+
+typedef x86_flags_t spin_lock_saved_state_t;
+
+static inline void spin_lock_init(spin_lock_t *lock) {
+    lock->next = 0;
+    lock->owner = 0;
+}
+
+static inline void spin_lock(spin_lock_t *lock) {
+    uint32_t ticket = atomic_fetch_add(&lock->next, 1);
+    while (atomic_load(&lock->owner) != ticket) {
+        arch_spin_pause();
+    }
+}
+
+static inline bool spin_trylock(spin_lock_t *lock) {
+    uint32_t owner = atomic_load(&lock->owner);
+    return atomic_cmpxchg(&lock->next, owner, owner + 1) == owner;
+}
+
+static inline void spin_unlock(spin_lock_t *lock) {
+    // only the holder writes owner, so a plain increment after a barrier will do
+    atomic_store(&lock->owner, lock->owner + 1);
+}
+
+static inline bool spin_lock_held(spin_lock_t *lock) {
+    return atomic_load(&lock->next) != atomic_load(&lock->owner);
+}
+
+#define spin_lock_irqsave(lock, statep) \
+    do { \
+        *(statep) = x86_irq_disable(); \
+        spin_lock(lock); \
+    } while (0)
+
+#define spin_unlock_irqrestore(lock, state) \
+    do { \
+        spin_unlock(lock); \
+        x86_irq_restore(state); \
+    } while (0)
@@ -0,0 +1,144 @@
+/*
+ * Copyright (c) 2019 Travis Geiselbrecht
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#pragma once
+
+#include <compiler.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+__BEGIN_CDECLS
+
+// lock free single producer, single consumer ring buffer of fixed size elements.
+//
+// meant for handing data from an irq handler to a task (or the other way
+// around) without disabling interrupts. exactly one context may enqueue and
+// exactly one may dequeue at a time, callers with more than one producer or
+// consumer must serialize them on their own.
+//
+// head and tail are free running counters, masked on access, so the element
+// count must be a power of 2. the producer only writes head and the consumer
+// only writes tail. each side publishes its index with a release store after
+// touching the elements, and reads the other side's index with an acquire load
+// before touching them. on x86 these are plain moves, the ordering mostly
+// keeps the compiler from moving the element copies across the index update.
+
+struct spsc_ring {
+    uint32_t head;      // next slot to fill, written by the producer
+    uint32_t tail;      // next slot to drain, written by the consumer
+    uint32_t mask;      // element count - 1
+    size_t esize;       // size of each element in bytes
+    uint8_t *buf;
+};
+
+#define SPSC_RING_INITIAL_VALUE(_buf) \
+    { 0, 0, countof(_buf) - 1, sizeof((_buf)[0]), (uint8_t *)(_buf) }
+
+static inline void spsc_ring_init(struct spsc_ring *r, void *buf, size_t count, size_t esize) {
+    r->head = r->tail = 0;
+    r->mask = count - 1;
+    r->esize = esize;
+    r->buf = buf;
+}
+
+// number of elements available to the consumer
+static inline size_t spsc_ring_count(const struct spsc_ring *r) {
+    return __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+}
+
+// number of free slots available to the producer
+static inline size_t spsc_ring_space(const struct spsc_ring *r) {
+    return r->mask + 1 - spsc_ring_count(r);
+}
+
+static inline bool spsc_ring_is_empty(const struct spsc_ring *r) {
+    return spsc_ring_count(r) == 0;
+}
+
+// copy count elements between the ring at index pos and a linear buffer,
+// splitting the copy where the ring wraps
+static inline void __spsc_ring_copy(const struct spsc_ring *r, uint32_t pos, void *ptr, size_t count, bool in) {
+    size_t offset = pos & r->mask;
+    size_t first = r->mask + 1 - offset;
+    if (first > count) {
+        first = count;
+    }
+
+    uint8_t *ring = r->buf + offset * r->esize;
+    if (in) {
+        memcpy(ring, ptr, first * r->esize);
+        memcpy(r->buf, (uint8_t *)ptr + first * r->esize, (count - first) * r->esize);
+    } else {
+        memcpy(ptr, ring, first * r->esize);
+        memcpy((uint8_t *)ptr + first * r->esize, r->buf, (count - first) * r->esize);
+    }
+}
+
+// producer side: add up to count elements, returns the number actually added
+static inline size_t spsc_ring_enqueue(struct spsc_ring *r, const void *items, size_t count) {
+    uint32_t head = r->head;
+    uint32_t tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+
+    size_t space = r->mask + 1 - (head - tail);
+    if (count > space) {
+        count = space;
+    }
+    if (count == 0) {
+        return 0;
+    }
+
+    __spsc_ring_copy(r, head, (void *)items, count, true);
+    __atomic_store_n(&r->head, head + count, __ATOMIC_RELEASE);
+
+    return count;
+}
+
+// consumer side: remove up to count elements, returns the number actually removed
+static inline size_t spsc_ring_dequeue(struct spsc_ring *r, void *items, size_t count) {
+    uint32_t tail = r->tail;
+    uint32_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+
+    size_t avail = head - tail;
+    if (count > avail) {
+        count = avail;
+    }
+    if (count == 0) {
+        return 0;
+    }
+
+    __spsc_ring_copy(r, tail, items, count, false);
+    __atomic_store_n(&r->tail, tail + count, __ATOMIC_RELEASE);
+
+    return count;
+}
+
+static inline bool spsc_ring_put(struct spsc_ring *r, const void *item) {
+    return spsc_ring_enqueue(r, item, 1) == 1;
+}
+
+static inline bool spsc_ring_get(struct spsc_ring *r, void *item) {
+    return spsc_ring_dequeue(r, item, 1) == 1;
+}
+
+__END_CDECLS
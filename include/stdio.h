@@ -27,4 +27,5 @@
 
 int putchar(int c);
 int puts(const char *c);
+int getchar(void);
 
@@ -27,5 +27,11 @@
 
 void *memcpy(void *dest, const void *src, size_t count);
 void *memset(void *s, int c, size_t count);
+int memcmp(const void *a, const void *b, size_t count) __PURE;
 
 size_t strlen(char const *) __PURE;
+
+// memcpy calls through memcpy_impl, which points at whichever of these suits the cpu
+extern void *(*memcpy_impl)(void *dest, const void *src, size_t count);
+void *memcpy_movsl(void *dest, const void *src, size_t count);
+void *memcpy_unrolled(void *dest, const void *src, size_t count);
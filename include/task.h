@@ -23,6 +23,7 @@
 #pragma once
 
 #include <list.h>
+#include <stdbool.h>
 #include <sys/types.h>
 #include <x86/x86.h>
 
@@ -33,10 +34,13 @@ typedef struct task {
         INITIAL,
         READY,
         RUNNING,
+        BLOCKED,
         DEAD
     } state;
 
     int critical_section_count;
+    uint32_t cpu;               // cpu it is running on, or last ran on
+    bool pinned;                // stays on cpu, other cpus won't steal it
 
     void (*entry)(void *);
     void *arg;
@@ -50,12 +54,48 @@ typedef struct task {
 void task_init(void);
 void task_become_idle(void);
 
+// set up the idle task for an application processor, called on that cpu
+void task_init_cpu(uintptr_t stack, size_t stack_size);
+
 status_t task_create(task_t *t, const char *name, void (*entry)(void *), void *arg, uintptr_t stack, size_t stack_size);
+// start on the next cpu in turn, free to move to another one when it is idle,
+// or pinned to a particular one for the rest of the task's life
 status_t task_start(task_t *t);
+status_t task_start_on(task_t *t, uint32_t cpu_num);
 void task_exit(void) __NO_RETURN;
 void task_reschedule(void);
 
-// manipulate a counter per task that disable/enables irqs
+task_t *task_get_current(void);
+
+// true if the idle task is the one currently running
+bool task_is_idle(void);
+
+// bracket irq processing. the exit switches tasks if one was woken up.
+void task_irq_enter(void);
+void task_irq_exit(void);
+
+// have the scheduler run at the end of the current irq
+void task_set_need_resched(void);
+
+// manipulate a counter per task that disable/enables irqs and holds the kernel lock
 void enter_critical_section(void);
 void exit_critical_section(void);
 
+// a list of tasks blocked waiting for something to happen
+typedef struct wait_queue {
+    struct list_node list;
+} wait_queue_t;
+
+#define WAIT_QUEUE_INITIAL_VALUE(q) { LIST_INITIAL_VALUE((q).list) }
+
+void wait_queue_init(wait_queue_t *wq);
+
+// block the current task on the queue. must be called inside a critical section,
+// which lets the caller check its wait condition without racing with the waker.
+void wait_queue_block(wait_queue_t *wq);
+
+// move one or all of the blocked tasks back to the run queue.
+// safe to call from irq context, returns the number of tasks woken.
+int wait_queue_wake_one(wait_queue_t *wq);
+int wait_queue_wake_all(wait_queue_t *wq);
+
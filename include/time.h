@@ -27,3 +27,8 @@
 // time in milliseconds since boot
 uint32_t current_time(void);
 
+// monotonic time in nanoseconds since boot, interpolated within the tick
+uint64_t current_time_ns(void);
+
+// select and calibrate the source for current_time_ns()
+void time_init(void);
@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2019 Travis Geiselbrecht
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#pragma once
+
+#include <list.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// one shot kernel timers, driven off the PIT tick or, when there is one, the
+// local apic timer. callbacks are run from irq context.
+
+struct timer;
+typedef void (*timer_callback)(struct timer *, uint32_t now, void *arg);
+
+typedef struct timer {
+    struct list_node node;
+
+    uint32_t scheduled_time;
+    timer_callback callback;
+    void *arg;
+} timer_t;
+
+#define TIMER_INITIAL_VALUE(t) { LIST_INITIAL_CLEARED_VALUE, 0, NULL, NULL }
+
+void timer_initialize(timer_t *t);
+
+// fire callback with arg at least delay milliseconds from now. rearming a
+// pending timer moves it. safe to call from irq context, including from the
+// timer's own callback.
+void timer_set_oneshot(timer_t *t, uint32_t delay, timer_callback callback, void *arg);
+void timer_cancel(timer_t *t);
+
+// called by the tick source with the current time
+void timer_tick(uint32_t now);
+
+// the expiry time of the next timer, false if none are pending. must be called
+// inside a critical section.
+bool timer_get_deadline(uint32_t *deadline);
@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2019 Travis Geiselbrecht
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#pragma once
+
+#include <compiler.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// cpu detection and the feature mask. the kernel is built for a 386, so code
+// that can do better on a later cpu tests these bits or calls through one of
+// the pointers x86_cpu_init() patches.
+
+#define X86_FEATURE_486     (1 << 0)    // bswap, xadd, cmpxchg, invlpg
+#define X86_FEATURE_CPUID   (1 << 1)
+#define X86_FEATURE_FPU     (1 << 2)
+#define X86_FEATURE_TSC     (1 << 3)
+#define X86_FEATURE_CX8     (1 << 4)
+#define X86_FEATURE_APIC    (1 << 5)
+#define X86_FEATURE_CMOV    (1 << 6)
+#define X86_FEATURE_MMX     (1 << 7)
+
+extern uint32_t x86_features;
+extern uint32_t x86_family;     // 3 for a 386, 4 for a 486 without cpuid
+
+static inline bool x86_feature_test(uint32_t feature) {
+    return (x86_features & feature) != 0;
+}
+
+// detect the cpu and pick the implementations below. run before anything
+// that depends on them, first thing in x86_init().
+void x86_cpu_init(void);
+void x86_cpu_dump(void);
+
+// invalidate the tlb entry for a page, with invlpg where there is one and a
+// full flush by reloading cr3 on a 386
+extern void (*x86_tlb_flush_page)(uintptr_t va);
+
+static inline void x86_tlb_flush_all(void) {
+    __asm__ volatile(
+        "mov %%cr3, %%eax;"
+        "mov %%eax, %%cr3"
+        ::: "eax", "memory");
+}
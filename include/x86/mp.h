@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2019 Travis Geiselbrecht
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <x86/x86.h>
+
+// the cpus and interrupt controllers in the machine, from the ACPI MADT or,
+// failing that, the older MP configuration table
+
+// polarity and trigger mode of an interrupt, in the encoding both tables use
+#define MP_IRQ_POLARITY_MASK    0x3
+#define MP_IRQ_POLARITY_LOW     0x3
+#define MP_IRQ_TRIGGER_MASK     0xc
+#define MP_IRQ_TRIGGER_LEVEL    0xc
+
+struct mp_config {
+    const char *source;         // which table it came from
+    uintptr_t lapic_addr;
+
+    uint32_t cpu_count;
+    uint8_t apic_ids[SMP_MAX_CPUS];
+
+    // the first io apic, or ioapic_addr 0 if there is none
+    uintptr_t ioapic_addr;
+    uint8_t ioapic_id;
+    uint32_t ioapic_gsi_base;
+
+    // where each isa irq lands on the io apic, identity unless overridden
+    struct {
+        uint8_t gsi;
+        uint8_t flags;
+    } isa_irq[16];
+
+    // the board boots in PIC mode and the IMCR has to be switched over
+    bool imcr;
+};
+
+extern struct mp_config mp_config;
+
+// search for the tables and fill in mp_config. false if neither was found.
+bool mp_init(void);
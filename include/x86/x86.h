@@ -32,14 +32,26 @@
 #define USER_DATA_32_SELECTOR   (0x20 | 3)
 #define KERNEL_TSS_SELECTOR 0x28
 
-#define GDT_COUNT           6
+#define SMP_MAX_CPUS        8
 
-// only implement 0x30 interrupts for now
-#define NUM_INT             0x30
+// page below 1MB that application processors start executing at
+#define SMP_TRAMPOLINE_BASE 0x8000
+
+// each cpu gets a tss, cpu 0's being KERNEL_TSS_SELECTOR, and a data segment
+// based at its struct percpu that it keeps loaded in fs
+#define X86_TSS_SELECTOR(cpu)       (KERNEL_TSS_SELECTOR + (cpu) * 8)
+#define X86_PERCPU_SELECTOR(cpu)    (KERNEL_TSS_SELECTOR + (SMP_MAX_CPUS + (cpu)) * 8)
+
+#define GDT_COUNT           (5 + 2 * SMP_MAX_CPUS)
+
+// exceptions, the 16 legacy irqs and the local apic vectors
+#define NUM_INT             0x40
 
 #ifndef __ASSEMBLER__
 
 #include <compiler.h>
+#include <irqsoff.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 // 32bit generic descriptors
@@ -194,7 +206,7 @@ static inline void x86_restore_flags(x86_flags_t flags) {
         : "memory", "cc");
 }
 
-static inline x86_flags_t x86_irq_disable(void) {
+static inline x86_flags_t __x86_irq_disable(void) {
     x86_flags_t state;
 
     __asm__ volatile(
@@ -207,7 +219,58 @@ static inline x86_flags_t x86_irq_disable(void) {
     return state;
 }
 
+#define X86_FLAGS_IF (1 << 9)
+
+// the irqsoff tracer times every window these open, from the point irqs were
+// on until the restore that turns them back on
+#if IRQSOFF_TRACE
+#define x86_irq_disable() ({ \
+    x86_flags_t __state = __x86_irq_disable(); \
+    if (__state & X86_FLAGS_IF) { \
+        irqsoff_start(irqsoff_caller()); \
+    } \
+    __state; \
+})
+
+#define x86_irq_restore(x) do { \
+    x86_flags_t __state = (x); \
+    if (__state & X86_FLAGS_IF) { \
+        irqsoff_stop(irqsoff_caller()); \
+    } \
+    x86_restore_flags(__state); \
+} while (0)
+#else
+#define x86_irq_disable() __x86_irq_disable()
 #define x86_irq_restore(x) x86_restore_flags(x)
+#endif
+
+// the ID bit in EFLAGS can only be toggled on cpus that implement cpuid
+#define X86_FLAGS_ID (1 << 21)
+
+static inline bool x86_has_cpuid(void) {
+    x86_flags_t flags = x86_save_flags();
+    x86_restore_flags(flags ^ X86_FLAGS_ID);
+    x86_flags_t toggled = x86_save_flags();
+    x86_restore_flags(flags);
+
+    return ((flags ^ toggled) & X86_FLAGS_ID) != 0;
+}
+
+static inline void x86_cpuid(uint32_t leaf, uint32_t *a, uint32_t *b, uint32_t *c, uint32_t *d) {
+    __asm__ __volatile__ ("cpuid"
+                          : "=a" (*a), "=b" (*b), "=c" (*c), "=d" (*d)
+                          : "a" (leaf), "c" (0));
+}
+
+// cpuid leaf 1 edx feature bits
+#define X86_CPUID_EDX_TSC   (1 << 4)
+
+// only valid if cpuid reports X86_CPUID_EDX_TSC
+static inline uint64_t x86_rdtsc(void) {
+    uint64_t tsc;
+    __asm__ __volatile__ ("rdtsc" : "=A" (tsc));
+    return tsc;
+}
 
 static inline uint8_t inp(uint16_t _port) {
     uint8_t rv;
@@ -259,7 +322,15 @@ extern struct x86_desc_32 gdt[];
 
 // functions
 void x86_init(void);
-void x86_tss_init(void);
+
+// the per cpu half of x86_init(), also run by each application processor
+void x86_init_cpu(uint32_t cpu_num);
+
+void x86_set_gdt_entry(uint16_t sel, uintptr_t base, uint32_t limit, uint8_t access, uint8_t flags);
+void x86_tss_init(struct x86_tss *tss, uint32_t cpu_num);
+
+// the interrupted state, only valid from within an irq handler
+struct x86_iframe *x86_get_irq_frame(void);
 
 struct task;
 int x86_init_task(struct task *task, uintptr_t entry_point, uint32_t sp);
@@ -0,0 +1,175 @@
+/*
+ * Copyright (c) 2019 Travis Geiselbrecht
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <irqsoff.h>
+
+#include <ksym.h>
+#include <smp.h>
+#include <spinlock.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <time.h>
+#include <hw/pit.h>
+#include <x86/x86.h>
+
+#if IRQSOFF_TRACE
+
+#define IRQSOFF_TOP_N   8
+
+struct irqsoff_window {
+    uint32_t duration_ns;
+    void *start_caller;
+    void *stop_caller;
+};
+
+// the results, shared by all cpus. every user already has irqs off.
+static spin_lock_t irqsoff_lock = SPIN_LOCK_INITIAL_VALUE;
+
+// the longest windows seen, sorted longest first
+static struct irqsoff_window top[IRQSOFF_TOP_N];
+
+static uint32_t latency_count;
+static uint32_t latency_max;
+static uint64_t latency_total;
+
+__NO_INLINE void *irqsoff_caller(void) {
+    return __GET_CALLER();
+}
+
+// windows are only timed once the PIT is counting, which is also after each
+// cpu has its percpu data
+void irqsoff_start(void *caller) {
+    if (!pit_is_running()) {
+        return;
+    }
+
+    struct irqsoff_cpu *cpu = &percpu_get()->irqsoff;
+    if (cpu->active) {
+        return;
+    }
+    cpu->start_ns = current_time_ns();
+    cpu->start_caller = caller;
+    cpu->active = true;
+}
+
+void irqsoff_stop(void *caller) {
+    if (!pit_is_running()) {
+        return;
+    }
+
+    // the first stop may close a window that was opened before tracing was up
+    struct irqsoff_cpu *cpu = &percpu_get()->irqsoff;
+    if (!cpu->active) {
+        return;
+    }
+    cpu->active = false;
+
+    uint64_t duration = current_time_ns() - cpu->start_ns;
+    if (duration > UINT32_MAX) {
+        duration = UINT32_MAX;
+    }
+
+    spin_lock(&irqsoff_lock);
+
+    if (duration <= top[IRQSOFF_TOP_N - 1].duration_ns) {
+        spin_unlock(&irqsoff_lock);
+        return;
+    }
+
+    // insertion sort into the table, dropping the shortest
+    int i = IRQSOFF_TOP_N - 1;
+    while (i > 0 && top[i - 1].duration_ns < duration) {
+        top[i] = top[i - 1];
+        i--;
+    }
+    top[i].duration_ns = duration;
+    top[i].start_caller = cpu->start_caller;
+    top[i].stop_caller = caller;
+
+    spin_unlock(&irqsoff_lock);
+}
+
+void irqsoff_pit_latency(uint32_t clocks) {
+    spin_lock(&irqsoff_lock);
+    latency_count++;
+    latency_total += clocks;
+    if (clocks > latency_max) {
+        latency_max = clocks;
+    }
+    spin_unlock(&irqsoff_lock);
+}
+
+void irqsoff_reset(void) {
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&irqsoff_lock, &state);
+
+    for (int i = 0; i < IRQSOFF_TOP_N; i++) {
+        top[i] = (struct irqsoff_window) { 0 };
+    }
+    latency_count = 0;
+    latency_max = 0;
+    latency_total = 0;
+
+    spin_unlock_irqrestore(&irqsoff_lock, state);
+}
+
+// PIT clocks to ns, close enough for reporting
+static uint32_t pit_clocks_to_ns(uint64_t clocks) {
+    return (clocks * 1000000000ULL) / PIT_FREQ;
+}
+
+void irqsoff_dump(void) {
+    struct irqsoff_window copy[IRQSOFF_TOP_N];
+
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&irqsoff_lock, &state);
+    for (int i = 0; i < IRQSOFF_TOP_N; i++) {
+        copy[i] = top[i];
+    }
+    uint32_t count = latency_count;
+    uint32_t max = latency_max;
+    uint64_t total = latency_total;
+    spin_unlock_irqrestore(&irqsoff_lock, state);
+
+    printf("longest irqs off windows:\n");
+    for (int i = 0; i < IRQSOFF_TOP_N && copy[i].duration_ns; i++) {
+        uintptr_t start_off = 0, stop_off = 0;
+        const char *start = ksym_lookup((uintptr_t)copy[i].start_caller, &start_off);
+        const char *stop = ksym_lookup((uintptr_t)copy[i].stop_caller, &stop_off);
+
+        printf("\t%8lu us from %s+%#lx to %s+%#lx\n", copy[i].duration_ns / 1000,
+               start ? start : "?", start_off, stop ? stop : "?", stop_off);
+    }
+
+    if (count) {
+        printf("PIT irq latency: %lu samples, avg %lu ns, max %lu ns\n", count,
+               pit_clocks_to_ns(total / count), pit_clocks_to_ns(max));
+    }
+}
+
+#else
+
+void irqsoff_dump(void) {
+    printf("irqsoff tracer not enabled, build with IRQSOFF_TRACE=1\n");
+}
+
+#endif
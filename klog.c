@@ -0,0 +1,274 @@
+/*
+ * Copyright (c) 2019 Travis Geiselbrecht
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <klog.h>
+
+#include <console.h>
+#include <printf.h>
+#include <spinlock.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <task.h>
+#include <time.h>
+#include <x86/x86.h>
+
+// the log is a byte ring of variable length records, each a header followed by
+// the text padded out to a 4 byte boundary. positions are free running byte
+// offsets that are masked on access, so head - tail is always the used length.
+
+#define KLOG_BUF_SIZE   8192    // must be a power of 2
+#define KLOG_MAX_LINE   64      // largest chunk of text in a single record
+
+struct klog_hdr {
+    uint32_t time;      // current_time() when the record was written
+    uint16_t len;       // length of the text that follows
+    uint16_t pad;
+};
+
+// guards the ring and the drain state. irq handlers log too, so it is always
+// taken with irqs disabled.
+static spin_lock_t klog_lock = SPIN_LOCK_INITIAL_VALUE;
+
+static uint8_t klog_buf[KLOG_BUF_SIZE];
+static uint32_t klog_head;      // where the next record is written
+static uint32_t klog_tail;      // oldest retained record
+static uint32_t klog_con;       // next record to be drained to the console
+static uint32_t klog_lost;      // records dropped before they made it to the console
+
+static bool klog_async;         // the drain task is running
+static bool klog_draining;      // someone is inside klog_drain()
+static wait_queue_t klog_wait = WAIT_QUEUE_INITIAL_VALUE(klog_wait);
+
+static task_t klog_task;
+static uint8_t klog_stack[1024] __ALIGNED(4);
+
+static inline size_t klog_reclen(size_t len) {
+    return ROUNDUP(sizeof(struct klog_hdr) + len, 4);
+}
+
+static void klog_copy_in(uint32_t pos, const void *_ptr, size_t len) {
+    const uint8_t *ptr = _ptr;
+    for (size_t i = 0; i < len; i++) {
+        klog_buf[(pos + i) & (KLOG_BUF_SIZE - 1)] = ptr[i];
+    }
+}
+
+static void klog_copy_out(void *_ptr, uint32_t pos, size_t len) {
+    uint8_t *ptr = _ptr;
+    for (size_t i = 0; i < len; i++) {
+        ptr[i] = klog_buf[(pos + i) & (KLOG_BUF_SIZE - 1)];
+    }
+}
+
+// pull records out one at a time under the lock and push them to the console
+// without it. nested calls (from an irq that logs while we're writing to
+// the console) return right away, the outer loop will pick up their records.
+static void klog_drain(void) {
+    char buf[KLOG_MAX_LINE];
+    uint32_t reported_lost = 0;
+
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&klog_lock, &state);
+    if (klog_draining) {
+        spin_unlock_irqrestore(&klog_lock, state);
+        return;
+    }
+    klog_draining = true;
+
+    while (klog_con != klog_head) {
+        struct klog_hdr hdr;
+        klog_copy_out(&hdr, klog_con, sizeof(hdr));
+        klog_copy_out(buf, klog_con + sizeof(hdr), hdr.len);
+        klog_con += klog_reclen(hdr.len);
+
+        uint32_t lost = klog_lost;
+        spin_unlock_irqrestore(&klog_lock, state);
+
+        if (lost != reported_lost) {
+            char msg[48];
+            int len = snprintf(msg, sizeof(msg), "\n<klog: %lu messages dropped>\n", lost - reported_lost);
+            console_write(msg, len, true);
+            reported_lost = lost;
+        }
+        console_write(buf, hdr.len, true);
+
+        spin_lock_irqsave(&klog_lock, &state);
+    }
+
+    klog_lost -= reported_lost;
+    klog_draining = false;
+    spin_unlock_irqrestore(&klog_lock, state);
+}
+
+static void klog_append(const char *str, size_t len) {
+    struct klog_hdr hdr = { .time = current_time(), .len = len };
+    size_t reclen = klog_reclen(len);
+
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&klog_lock, &state);
+
+    // make room by dropping the oldest records
+    while (klog_head + reclen - klog_tail > KLOG_BUF_SIZE) {
+        struct klog_hdr old;
+        klog_copy_out(&old, klog_tail, sizeof(old));
+        if (klog_con == klog_tail) {
+            klog_con += klog_reclen(old.len);
+            klog_lost++;
+        }
+        klog_tail += klog_reclen(old.len);
+    }
+
+    klog_copy_in(klog_head, &hdr, sizeof(hdr));
+    klog_copy_in(klog_head + sizeof(hdr), str, len);
+    klog_head += reclen;
+
+    spin_unlock_irqrestore(&klog_lock, state);
+
+    // after dropping the lock, since waking takes the kernel lock and irq
+    // handlers already hold that when they log. the drain task checks for
+    // records under the kernel lock, so the wakeup can't slip in between.
+    if (klog_async) {
+        wait_queue_wake_one(&klog_wait);
+    }
+}
+
+int klog_write(const char *str, size_t len) {
+    size_t pos = 0;
+
+    while (pos < len) {
+        size_t chunk = MIN(len - pos, KLOG_MAX_LINE);
+        klog_append(str + pos, chunk);
+        pos += chunk;
+    }
+
+    if (!klog_async) {
+        klog_drain();
+    }
+
+    return len;
+}
+
+struct klog_printf_state {
+    size_t pos;
+    char buf[KLOG_MAX_LINE];
+};
+
+// collect formatted output into line sized chunks before appending it to the log
+static int klog_printf_output(const char *str, size_t len, void *_state) {
+    struct klog_printf_state *state = _state;
+
+    for (size_t i = 0; i < len; i++) {
+        state->buf[state->pos++] = str[i];
+        if (str[i] == '\n' || state->pos == sizeof(state->buf)) {
+            klog_write(state->buf, state->pos);
+            state->pos = 0;
+        }
+    }
+
+    return len;
+}
+
+int klog_vprintf(const char *fmt, va_list ap) {
+    struct klog_printf_state state;
+    state.pos = 0;
+
+    int err = _printf_engine(&klog_printf_output, &state, fmt, ap);
+    if (state.pos > 0) {
+        klog_write(state.buf, state.pos);
+    }
+
+    return err;
+}
+
+static void klog_thread(void *arg) {
+    for (;;) {
+        enter_critical_section();
+        while (klog_con == klog_head) {
+            wait_queue_block(&klog_wait);
+        }
+        exit_critical_section();
+
+        klog_drain();
+    }
+}
+
+void klog_init(void) {
+    task_create(&klog_task, "klog", &klog_thread, NULL, (uintptr_t)klog_stack, sizeof(klog_stack));
+
+    klog_async = true;
+    task_start(&klog_task);
+}
+
+void klog_flush(void) {
+    klog_drain();
+}
+
+void klog_panic(void) {
+    x86_cli();
+
+    // another cpu may have died holding the lock
+    spin_lock_init(&klog_lock);
+    klog_async = false;
+    klog_draining = false;
+    klog_drain();
+}
+
+void klog_dump(void) {
+    char buf[KLOG_MAX_LINE + 16];
+    bool newline = true;
+
+    // dump directly to the console, since logging while walking the log would
+    // push out the records being walked
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&klog_lock, &state);
+    uint32_t pos = klog_tail;
+    spin_unlock_irqrestore(&klog_lock, state);
+
+    for (;;) {
+        struct klog_hdr hdr;
+        char text[KLOG_MAX_LINE];
+
+        spin_lock_irqsave(&klog_lock, &state);
+        // the writer may have lapped us while we were printing
+        if ((int32_t)(pos - klog_tail) < 0) {
+            pos = klog_tail;
+        }
+        if (pos == klog_head) {
+            spin_unlock_irqrestore(&klog_lock, state);
+            break;
+        }
+        klog_copy_out(&hdr, pos, sizeof(hdr));
+        klog_copy_out(text, pos + sizeof(hdr), hdr.len);
+        pos += klog_reclen(hdr.len);
+        spin_unlock_irqrestore(&klog_lock, state);
+
+        int len = 0;
+        if (newline) {
+            len = snprintf(buf, sizeof(buf), "[%5lu.%03lu] ", hdr.time / 1000, hdr.time % 1000);
+        }
+        memcpy(buf + len, text, hdr.len);
+        console_write(buf, len + hdr.len, true);
+
+        newline = (hdr.len > 0 && text[hdr.len - 1] == '\n');
+    }
+}
@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2019 Travis Geiselbrecht
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <ktrace.h>
+
+#include <atomic.h>
+#include <printf.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <task.h>
+#include <time.h>
+#include <hw/uart.h>
+#include <x86/x86.h>
+
+#if KTRACE
+
+#define KTRACE_RECORDS  256     // must be a power of 2
+
+struct ktrace_record {
+    uint64_t time;      // current_time_ns()
+    uint16_t id;        // index into the ktrace_events section
+    uint8_t  phase;
+    uint8_t  pad;
+    uint32_t task;      // task running, or interrupted, when recorded
+    uint32_t a;
+    uint32_t b;
+    uint32_t seq;       // head value that claimed it, plus one, once filled in
+};
+
+extern const struct ktrace_event __ktrace_events_start[];
+extern const struct ktrace_event __ktrace_events_end[];
+
+static struct ktrace_record ktrace_buf[KTRACE_RECORDS];
+static uint32_t ktrace_head;    // free running count of records written
+static bool ktrace_paused;
+
+// a slot is claimed with an atomic add and then filled in with irqs left on.
+// an irq that records in the middle gets a slot of its own. seq is cleared
+// while the record is being written and set last, so the dump can tell a
+// record that was still being filled in, here or on another cpu, from a
+// complete one.
+void ktrace_record(const struct ktrace_event *ev, char phase, uint32_t a, uint32_t b) {
+    if (ktrace_paused) {
+        return;
+    }
+
+    uint32_t slot = atomic_fetch_add(&ktrace_head, 1);
+    struct ktrace_record *r = &ktrace_buf[slot & (KTRACE_RECORDS - 1)];
+    atomic_store(&r->seq, 0);
+    r->time = current_time_ns();
+    r->id = ev - __ktrace_events_start;
+    r->phase = phase;
+    r->task = (uintptr_t)task_get_current();
+    r->a = a;
+    r->b = b;
+    atomic_store(&r->seq, slot + 1);
+}
+
+static int ktrace_uart_out(const char *str, size_t len, void *state) {
+    for (size_t i = 0; i < len; i++) {
+        if (str[i] == '\n') {
+            uart_putchar('\r');
+        }
+        uart_putchar(str[i]);
+    }
+    return len;
+}
+
+// each line goes out in one piece, so it doesn't interleave with the klog task
+static void ktrace_printf(const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    enter_critical_section();
+    _printf_engine(&ktrace_uart_out, NULL, fmt, ap);
+    exit_critical_section();
+    va_end(ap);
+}
+
+void ktrace_dump(void) {
+    // stop recording so the ring holds still while it is written out
+    enter_critical_section();
+    ktrace_paused = true;
+    uint32_t head = ktrace_head;
+    exit_critical_section();
+
+    uint32_t count = head < KTRACE_RECORDS ? head : KTRACE_RECORDS;
+    uint32_t event_count = __ktrace_events_end - __ktrace_events_start;
+
+    ktrace_printf("ktrace: begin %lu events %lu records %lu dropped\n", event_count, count,
+                  head - count);
+
+    for (uint32_t i = 0; i < event_count; i++) {
+        ktrace_printf("ktrace: E %lu %s\n", i, __ktrace_events_start[i].name);
+    }
+
+    for (uint32_t pos = head - count; pos != head; pos++) {
+        const struct ktrace_record *r = &ktrace_buf[pos & (KTRACE_RECORDS - 1)];
+        if (atomic_load((volatile uint32_t *)&r->seq) != pos + 1) {
+            // torn, or overwritten by a later lap
+            continue;
+        }
+        ktrace_printf("ktrace: R %llu %u %c %lx %lx %lx\n", r->time, r->id, r->phase,
+                      r->task, r->a, r->b);
+    }
+
+    ktrace_printf("ktrace: end\n");
+
+    enter_critical_section();
+    ktrace_head = 0;
+    ktrace_paused = false;
+    exit_critical_section();
+}
+
+#else
+
+void ktrace_dump(void) {
+    printf("ktrace not enabled, build with KTRACE=1\n");
+}
+
+#endif
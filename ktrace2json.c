@@ -0,0 +1,115 @@
+/*
+** Copyright 2018, Travis Geiselbrecht. All rights reserved.
+** Distributed under the terms of the NewOS License.
+*/
+// convert a ktrace dump captured from the serial port into chrome trace json,
+// for viewing in chrome://tracing or perfetto.
+//
+// usage: ktrace2json [serial log] > trace.json
+//
+// only lines containing "ktrace: " are looked at, so the raw serial log can be
+// fed in directly. if there are several dumps in the log the last one wins.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_EVENTS 1024
+#define MAX_NAME 64
+
+static char event_names[MAX_EVENTS][MAX_NAME];
+
+struct record {
+    unsigned long long time;
+    unsigned int id;
+    char phase;
+    unsigned long task;
+    unsigned long a;
+    unsigned long b;
+};
+
+static struct record *records;
+static size_t record_count;
+static size_t record_alloc;
+
+static void reset(void) {
+    memset(event_names, 0, sizeof(event_names));
+    record_count = 0;
+}
+
+static void add_record(const struct record *r) {
+    if (record_count == record_alloc) {
+        record_alloc = record_alloc ? record_alloc * 2 : 256;
+        records = realloc(records, record_alloc * sizeof(struct record));
+        if (!records) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+    }
+    records[record_count++] = *r;
+}
+
+int main(int argc, char *argv[]) {
+    FILE *in = stdin;
+    char line[256];
+    int seen_end = 0;
+
+    if (argc > 2) {
+        fprintf(stderr, "usage: %s [serial log]\n", argv[0]);
+        return 1;
+    }
+    if (argc == 2) {
+        in = fopen(argv[1], "r");
+        if (!in) {
+            perror(argv[1]);
+            return 1;
+        }
+    }
+
+    while (fgets(line, sizeof(line), in)) {
+        char *p = strstr(line, "ktrace: ");
+        if (!p) {
+            continue;
+        }
+        p += strlen("ktrace: ");
+
+        if (strncmp(p, "begin", 5) == 0) {
+            reset();
+            seen_end = 0;
+        } else if (strncmp(p, "end", 3) == 0) {
+            seen_end = 1;
+        } else if (p[0] == 'E') {
+            unsigned int id;
+            char name[MAX_NAME];
+            if (sscanf(p, "E %u %63s", &id, name) == 2 && id < MAX_EVENTS) {
+                strcpy(event_names[id], name);
+            }
+        } else if (p[0] == 'R') {
+            struct record r;
+            if (sscanf(p, "R %llu %u %c %lx %lx %lx", &r.time, &r.id, &r.phase,
+                       &r.task, &r.a, &r.b) == 6) {
+                add_record(&r);
+            }
+        }
+    }
+
+    if (!seen_end) {
+        fprintf(stderr, "warning: no complete ktrace dump found\n");
+    }
+
+    printf("{\"traceEvents\":[\n");
+    for (size_t i = 0; i < record_count; i++) {
+        const struct record *r = &records[i];
+        const char *name = (r->id < MAX_EVENTS && event_names[r->id][0]) ? event_names[r->id] : "unknown";
+
+        // chrome wants microseconds, keep the ns as a fraction
+        printf("%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%llu.%03llu,\"pid\":0,\"tid\":%lu,",
+               i ? ",\n" : "", name, r->phase, r->time / 1000, r->time % 1000, r->task);
+        if (r->phase == 'i') {
+            printf("\"s\":\"t\",");
+        }
+        printf("\"args\":{\"a\":\"%#lx\",\"b\":\"%#lx\"}}", r->a, r->b);
+    }
+    printf("\n]}\n");
+
+    return 0;
+}
@@ -21,9 +21,17 @@
  * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 #include <stdint.h>
+#include <bench.h>
+#include <boot_params.h>
+#include <boottime.h>
 #include <debug.h>
+#include <delay.h>
+#include <e820.h>
 #include <compiler.h>
 #include <heap.h>
+#include <klog.h>
+#include <ktrace.h>
+#include <smp.h>
 #include <stdio.h>
 #include <task.h>
 #include <time.h>
@@ -31,20 +39,18 @@
 #include <hw/keyboard.h>
 #include <hw/pic.h>
 #include <hw/pit.h>
+#include <hw/rtc.h>
+#include <hw/uart.h>
+#include <x86/cpu.h>
 #include <x86/x86.h>
 
+// default stack for the boot completion thread, boot.stack overrides it
+#define BOOT_STACK_SIZE 1024
+
 static void task_test_routine(void *);
 
 static void main2(void *arg);
 
-struct e820 {
-    uint64_t base;      // 0x0
-    uint64_t len;       // 0x8
-    uint32_t type;      // 0x10
-
-    uint8_t  pad[0xc];  // pad out to 0x20 bytes, as returned by the bootloader
-} __PACKED;
-
 static void dump_e820(const void *ptr, size_t count) {
     const struct e820 *e820 = ptr;
 
@@ -53,34 +59,85 @@ static void dump_e820(const void *ptr, size_t count) {
     }
 }
 
+// end of the ram the kernel is loaded into at 1MB, from the e820 map or the
+// bootloader's memory probe
+static uintptr_t find_mem_top(unsigned int mem, const struct e820 *e820, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        if (e820[i].type == E820_TYPE_RAM && e820[i].base <= 0x100000 &&
+                e820[i].base + e820[i].len > 0x100000) {
+            uint64_t top = e820[i].base + e820[i].len;
+            return (top > UINT32_MAX) ? UINT32_MAX : top;
+        }
+    }
+    return mem;
+}
+
 // main C entry point
-void _start_c(unsigned int mem, struct e820 *ext_mem_block, size_t ext_mem_count, int in_vesa, void *vesa_ptr) {
+void _start_c(unsigned int mem, struct e820 *ext_mem_block, size_t ext_mem_count, int in_vesa, void *vesa_ptr,
+              uint32_t bios_ticks_start, uint32_t bios_ticks_loaded, const struct boot_params *boot_params) {
+    boottime_init(bios_ticks_start, bios_ticks_loaded);
+    boot_params_init(boot_params);
+
     // initialize the vga text console
     console_init();
+    boottime_mark("console_init");
 
     x86_init();
+    boottime_mark("x86_init");
 
     printf("Welcome to 3x86 OS\n");
 
+    x86_cpu_dump();
+
     printf("Arguments from bootloader:\n\tmem %#x\n\text_mem_block %p ext_mem_count %zu\n\tin_vesa %d vesa_ptr %p\n",
            mem, ext_mem_block, ext_mem_count, in_vesa, vesa_ptr);
 
     dump_e820(ext_mem_block, ext_mem_count);
 
+    boot_params_dump();
+
     // initialize early hardware
     pic_init();
+    boottime_mark("pic_init");
     pit_init();
+    boottime_mark("pit_init");
+    delay_calibrate();
+    boottime_mark("delay_calibrate");
+    time_init();
+    boottime_mark("time_init");
+    rtc_init();
+    boottime_mark("rtc_init");
 
     // initialize the tasking subsystem
     task_init();
+    boottime_mark("task_init");
 
     // initialize the heap
-    heap_init();
+    heap_init(find_mem_top(mem, ext_mem_block, ext_mem_count));
+    boottime_mark("heap_init");
+
+    // move console output to its own task
+    klog_init();
+    boottime_mark("klog_init");
+
+    // switch to the apics and bring up the other cpus, they idle until there
+    // is work for them
+    smp_init();
+    boottime_mark("smp_init");
 
     // create the boot completion thread
+    size_t boot_stack_size = boot_param_uint("boot.stack", BOOT_STACK_SIZE);
     task_t *boot_thread = malloc(sizeof(task_t));
-    uint8_t *boot_stack = malloc(512);
-    task_create(boot_thread, "boot", &main2, NULL, (uintptr_t)boot_stack, 512);
+    uint8_t *boot_stack = malloc(boot_stack_size);
+    if (!boot_stack && boot_stack_size != BOOT_STACK_SIZE) {
+        printf("boot.stack %zu does not fit in the heap, using the default\n", boot_stack_size);
+        boot_stack_size = BOOT_STACK_SIZE;
+        boot_stack = malloc(boot_stack_size);
+    }
+    if (!boot_thread || !boot_stack) {
+        panic("out of memory for the boot thread\n");
+    }
+    task_create(boot_thread, "boot", &main2, NULL, (uintptr_t)boot_stack, boot_stack_size);
     task_start(boot_thread);
 
     // kick off the scheduler and become the idle thread
@@ -92,8 +149,24 @@ void main2(void *arg) {
 
     // initialize additional drivers and subsystems here
     keyboard_init();
+    boottime_mark("keyboard_init");
+    uart_init_irq();
+    boottime_mark("uart_init_irq");
 
     heap_dump();
 
+    boottime_dump();
+
+    // the suite prints its own stats, including the profile and trace, and
+    // never returns. the rest is for a normal boot.
+    if (BENCH) {
+        bench_run();
+    }
+
+    // write out the trace of the boot for ktrace2json
+    if (KTRACE) {
+        ktrace_dump();
+    }
+
     printf("secondary boot thread exiting\n");
 }
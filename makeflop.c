@@ -8,30 +8,165 @@
 #include <unistd.h>
 #include <string.h>
 #include <fcntl.h>
+#include <stdint.h>
+
+#include "include/boot_image.h"
+#include "include/boot_params.h"
 
 #ifndef O_BINARY
 #define O_BINARY 0
 #endif
 
 void usage(char const *progname) {
-    printf("usage: %s [-p #padding] [-v] [-x xres ] [-y yres] [-d bitdepth] bootblock payload outfile\n", progname);
+    printf("usage: %s [-p #padding] [-v] [-x xres ] [-y yres] [-d bitdepth] [-z stub] [-H] [-c cmdline] bootblock payload outfile\n", progname);
 }
 
-int main(int argc, char *argv[]) {
+// read a whole file into a malloced buffer
+static unsigned char *read_file(char const *path, size_t *size) {
     struct stat st;
-    int err;
+    unsigned char *buf;
+    int fd;
+
+    fd = open(path, O_BINARY|O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        fprintf(stderr, "error: cannot open input file '%s'\n", path);
+        return NULL;
+    }
+
+    buf = malloc(st.st_size);
+    if (!buf || read(fd, buf, st.st_size) != st.st_size) {
+        fprintf(stderr, "error reading input file '%s'\n", path);
+        return NULL;
+    }
+    close(fd);
+
+    *size = st.st_size;
+    return buf;
+}
+
+static void put32(unsigned char *p, uint32_t val) {
+    p[0] = val;
+    p[1] = val >> 8;
+    p[2] = val >> 16;
+    p[3] = val >> 24;
+}
+
+// greedy lzss with a brute force search of the window, in the format described
+// in boot_image.h. returns the compressed size; out must hold in_size * 9 / 8 + 1.
+static size_t lzss_compress(unsigned char *out, const unsigned char *in, size_t in_size) {
+    size_t pos = 0;
+    size_t out_pos = 0;
+
+    while (pos < in_size) {
+        size_t flag_pos = out_pos++;
+        out[flag_pos] = 0;
+
+        for (int bit = 0; bit < 8 && pos < in_size; bit++) {
+            size_t best_len = 0;
+            size_t best_dist = 0;
+            size_t max_len = in_size - pos;
+            if (max_len > LZSS_MAX_MATCH) {
+                max_len = LZSS_MAX_MATCH;
+            }
+
+            size_t start = pos > LZSS_WINDOW ? pos - LZSS_WINDOW : 0;
+            for (size_t i = start; i < pos; i++) {
+                size_t len = 0;
+                while (len < max_len && in[i + len] == in[pos + len]) {
+                    len++;
+                }
+                if (len > best_len) {
+                    best_len = len;
+                    best_dist = pos - i;
+                    if (len == max_len) {
+                        break;
+                    }
+                }
+            }
+
+            if (best_len >= LZSS_MIN_MATCH) {
+                unsigned int v = (best_dist - 1) | ((best_len - LZSS_MIN_MATCH) << 12);
+                out[out_pos++] = v;
+                out[out_pos++] = v >> 8;
+                pos += best_len;
+            } else {
+                out[flag_pos] |= 1 << bit;
+                out[out_pos++] = in[pos++];
+            }
+        }
+    }
+
+    return out_pos;
+}
+
+// build stub + lzss header + compressed kernel. the stub is padded so the
+// header that follows it is aligned.
+static unsigned char *compress_payload(char const *stub_path, const unsigned char *payload,
+                                       size_t payload_size, size_t *out_size) {
+    unsigned char *stub;
+    size_t stub_size;
+
+    // the kernel is decompressed to KERNEL_LOAD_BASE, below the stub and its
+    // input at STUB_BASE, so it can't be any bigger than the gap
+    if (payload_size > STUB_BASE - KERNEL_LOAD_BASE) {
+        fprintf(stderr, "error: kernel is %zu bytes, more than the %u a compressed image can hold\n",
+                payload_size, STUB_BASE - KERNEL_LOAD_BASE);
+        return NULL;
+    }
+
+    stub = read_file(stub_path, &stub_size);
+    if (!stub) {
+        return NULL;
+    }
+
+    size_t header_off = (stub_size + 3) & ~3;
+    size_t data_off = header_off + sizeof(struct lzss_header);
+    unsigned char *out = calloc(1, data_off + payload_size * 9 / 8 + 1);
+    if (!out) {
+        free(stub);
+        return NULL;
+    }
+
+    memcpy(out, stub, stub_size);
+    size_t compressed = lzss_compress(out + data_off, payload, payload_size);
+
+    put32(out + header_off, BOOT_IMAGE_LZSS_MAGIC);
+    put32(out + header_off + 4, compressed);
+    put32(out + header_off + 8, payload_size);
+
+    printf("makeflop: compressed kernel %zu -> %zu bytes (%zu%%), stub %zu bytes\n",
+           payload_size, compressed, compressed * 100 / payload_size, stub_size);
+
+    free(stub);
+
+    // the stub copies itself and the compressed data forward from
+    // KERNEL_LOAD_BASE to STUB_BASE, which only works if the two don't overlap
+    if (data_off + compressed > STUB_BASE - KERNEL_LOAD_BASE) {
+        fprintf(stderr, "error: stub and compressed kernel are %zu bytes, more than the %u a compressed image can hold\n",
+                data_off + compressed, STUB_BASE - KERNEL_LOAD_BASE);
+        free(out);
+        return NULL;
+    }
+    *out_size = data_off + compressed;
+    return out;
+}
+
+int main(int argc, char *argv[]) {
     unsigned int blocks;
     unsigned char bootsector[1024];
-    unsigned char buf[512];
-    size_t read_size;
+    unsigned char *payload;
+    size_t payload_size;
     size_t written_bytes;
     int padding;
     int enable_vesa;
+    int hard_disk;
     int vesa_x, vesa_y, vesa_bit;
     int infd;
     int outfd;
     signed char opt;
     char const *progname;
+    char const *stub_path;
+    char const *cmdline;
 
     padding = 0;
     progname = argv[0];
@@ -39,8 +174,11 @@ int main(int argc, char *argv[]) {
     vesa_x = 640;
     vesa_y = 480;
     vesa_bit = 16;
+    stub_path = NULL;
+    hard_disk = 0;
+    cmdline = NULL;
 
-    while ( (opt = getopt(argc, argv, "p:vx:y:d:")) != -1)
+    while ( (opt = getopt(argc, argv, "p:vx:y:d:z:Hc:")) != -1)
         switch (opt) {
             case 'p':
                 padding= atoi(optarg);
@@ -73,6 +211,18 @@ int main(int argc, char *argv[]) {
                     return -1;
                 }
                 break;
+            case 'z':
+                stub_path = optarg;
+                break;
+            case 'H':
+                // hard disk image, padded to whole 16 head, 63 sector
+                // cylinders so the bios and qemu agree on its geometry
+                hard_disk = 1;
+                padding = 16 * 63 * 512;
+                break;
+            case 'c':
+                cmdline = optarg;
+                break;
             case '?':
             default:
                 usage(progname);
@@ -87,12 +237,20 @@ int main(int argc, char *argv[]) {
         return -1;
     }
 
-    err = stat(argv[2], &st);
-    if (err < 0) {
-        fprintf(stderr, "error stating file '%s'\n", argv[2]);
+    payload = read_file(argv[2], &payload_size);
+    if (!payload) {
         return -1;
     }
 
+    if (stub_path) {
+        unsigned char *compressed = compress_payload(stub_path, payload, payload_size, &payload_size);
+        if (!compressed) {
+            return -1;
+        }
+        free(payload);
+        payload = compressed;
+    }
+
     outfd = open(argv[3], O_BINARY|O_WRONLY|O_CREAT|O_TRUNC, 0666);
     if (outfd < 0) {
         fprintf(stderr, "error: cannot open output file '%s'\n", argv[3]);
@@ -113,11 +271,18 @@ int main(int argc, char *argv[]) {
     close(infd);
 
     // patch the size of the output into bytes 3 & 4 of the bootblock
-    blocks = st.st_size / 512;
-    if ((st.st_size % 512) != 0) {
+    blocks = payload_size / 512;
+    if ((payload_size % 512) != 0) {
         blocks++;
     }
-    printf("makeflop: size %zu, blocks %d (size %d)\n", st.st_size, blocks, blocks * 512);
+    printf("makeflop: size %zu, blocks %d (size %d)\n", payload_size, blocks, blocks * 512);
+    if (blocks > 0xffff) {
+        fprintf(stderr, "error: payload too large for the bootblock\n");
+        return -1;
+    }
+    if (!hard_disk && blocks + 2 > 80 * 18 * 2) {
+        fprintf(stderr, "warning: image does not fit on a 1.44MB floppy, use -H\n");
+    }
     bootsector[2] = (blocks & 0x00ff);
     bootsector[3] = (blocks & 0xff00) >> 8;
 
@@ -131,6 +296,26 @@ int main(int argc, char *argv[]) {
         bootsector[517] = vesa_bit;
     }
 
+    if (cmdline) {
+        // patch the command line into the boot params block at the end of the bootblock
+        unsigned char *params = bootsector + BOOT_PARAMS_OFFSET;
+        if (params[0] != (BOOT_PARAMS_MAGIC & 0xff) || params[1] != ((BOOT_PARAMS_MAGIC >> 8) & 0xff) ||
+                params[2] != ((BOOT_PARAMS_MAGIC >> 16) & 0xff) || params[3] != (BOOT_PARAMS_MAGIC >> 24) ||
+                params[4] != BOOT_PARAMS_VERSION) {
+            fprintf(stderr, "error: bootblock '%s' has no version %d boot params block\n", argv[1], BOOT_PARAMS_VERSION);
+            return -1;
+        }
+        if (strlen(cmdline) >= BOOT_PARAMS_CMDLINE_LEN) {
+            fprintf(stderr, "error: command line longer than %d bytes\n", BOOT_PARAMS_CMDLINE_LEN - 1);
+            return -1;
+        }
+        memset(params + 8, 0, BOOT_PARAMS_CMDLINE_LEN);
+        memcpy(params + 8, cmdline, strlen(cmdline));
+        if (*cmdline) {
+            printf("makeflop: boot params '%s'\n", cmdline);
+        }
+    }
+
     ssize_t written = write(outfd, bootsector, sizeof(bootsector));
     if (written != sizeof(bootsector)) {
         fprintf(stderr, "error writing to output file\n");
@@ -138,20 +323,13 @@ int main(int argc, char *argv[]) {
     }
     written_bytes = written;
 
-    infd = open(argv[2], O_BINARY|O_RDONLY);
-    if (infd < 0) {
-        fprintf(stderr, "error: cannot open input file '%s'\n", argv[1]);
-        return -1;
-    }
-
-    while ((read_size = read(infd, buf, sizeof(buf))) > 0) {
-        written = write(outfd, buf, read_size);
-        if (written != read_size) {
-            fprintf(stderr, "error writing to output file\n");
-            return 1;
-        }
-        written_bytes += written;
+    written = write(outfd, payload, payload_size);
+    if (written != payload_size) {
+        fprintf(stderr, "error writing to output file\n");
+        return 1;
     }
+    written_bytes += written;
+    free(payload);
 
     if (padding) {
         if (written_bytes % padding) {
@@ -171,7 +349,6 @@ int main(int argc, char *argv[]) {
     }
 
     close(outfd);
-    close(infd);
 
     return 0;
 }
@@ -350,7 +350,12 @@ void *miniheap_realloc(void *ptr, size_t size) {
         return NULL;
     }
 
-    memcpy(p, ptr, size); // XXX wrong
+    // copy no more than the old block holds, which runs from ptr to the end of
+    // its chunk
+    struct alloc_struct_begin *as = (struct alloc_struct_begin *)ptr;
+    as--;
+    size_t old_size = (addr_t)as->ptr + as->size - (addr_t)ptr;
+    memcpy(p, ptr, MIN(size, old_size));
     miniheap_free(ptr);
 
     return p;
@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2019 Travis Geiselbrecht
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <multiboot.h>
+
+#include <boot_params.h>
+#include <compiler.h>
+#include <e820.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <x86/x86.h>
+
+#define MAX_E820 32
+
+// the regular entry point, which clears bss, switches stacks and calls _start_c
+// with these arguments, in the same layout the bootblock pushes them
+void _start(unsigned int mem, struct e820 *ext_mem_block, size_t ext_mem_count, int in_vesa,
+            void *vesa_ptr, uint32_t bios_ticks_start, uint32_t bios_ticks_loaded,
+            const struct boot_params *boot_params) __NO_RETURN;
+
+// this runs before bss is cleared, so anything it keeps has to live in data
+static struct e820 mb_e820[MAX_E820] __SECTION(".data");
+static struct boot_params mb_params __SECTION(".data");
+
+void multiboot_start_c(uint32_t magic, const struct multiboot_info *info) __NO_RETURN;
+void multiboot_start_c(uint32_t magic, const struct multiboot_info *info) {
+    if (magic != MULTIBOOT_BOOTLOADER_MAGIC) {
+        for (;;) {
+            x86_hlt();
+        }
+    }
+
+    size_t count = 0;
+    if (info->flags & MULTIBOOT_INFO_MEM_MAP) {
+        uintptr_t pos = info->mmap_addr;
+        uintptr_t end = pos + info->mmap_length;
+        while (pos < end && count < MAX_E820) {
+            const struct multiboot_mmap_entry *mmap = (const void *)pos;
+
+            mb_e820[count].base = mmap->addr;
+            mb_e820[count].len = mmap->len;
+            mb_e820[count].type = mmap->type;
+            count++;
+
+            pos += mmap->size + sizeof(mmap->size);
+        }
+    }
+
+    // without a map, hand over the size of memory above 1MB like the bootblock's probe
+    unsigned int mem = 0;
+    if (count == 0 && (info->flags & MULTIBOOT_INFO_MEMORY)) {
+        mem = 0x100000 + info->mem_upper * 1024;
+    }
+
+    // the multiboot command line becomes the boot params
+    if (info->flags & MULTIBOOT_INFO_CMDLINE) {
+        const char *cmdline = (const char *)info->cmdline;
+        mb_params.magic = BOOT_PARAMS_MAGIC;
+        mb_params.version = BOOT_PARAMS_VERSION;
+        mb_params.size = BOOT_PARAMS_SIZE;
+        for (size_t i = 0; i < sizeof(mb_params.cmdline) - 1 && cmdline[i]; i++) {
+            mb_params.cmdline[i] = cmdline[i];
+        }
+    }
+
+    // no bootloader timing, the loader is too quick to be worth it
+    _start(mem, mb_e820, count, 0, NULL, 0, 0, &mb_params);
+}
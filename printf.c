@@ -25,7 +25,7 @@
 #include <compiler.h>
 #include <stdarg.h>
 #include <string.h>
-#include <console.h>
+#include <klog.h>
 #include <sys/types.h>
 
 #define WITH_NO_FP 1
@@ -653,7 +653,7 @@ int _printf(const char *fmt, ...) {
 }
 
 int _vprintf(const char *fmt, va_list ap) {
-    return _printf_engine((void *)&console_write, (void *)1, fmt, ap);
+    return klog_vprintf(fmt, ap);
 }
 
 
@@ -0,0 +1,138 @@
+/*
+ * Copyright (c) 2019 Travis Geiselbrecht
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <profile.h>
+
+#include <heap.h>
+#include <ksym.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <task.h>
+#include <hw/rtc.h>
+#include <x86/x86.h>
+
+#define PROFILE_TOP_N   20
+
+// the histogram is binned by symbol rather than by raw address, which keeps
+// it small enough for the heap and is the resolution the dump reports at anyway
+static uint32_t *sym_samples;
+static uint32_t unknown_samples;
+static uint32_t idle_samples;
+static uint32_t total_samples;
+static bool running;
+
+static void profile_sample(void *arg) {
+    struct x86_iframe *frame = x86_get_irq_frame();
+    if (!frame) {
+        return;
+    }
+
+    total_samples++;
+
+    if (task_is_idle()) {
+        idle_samples++;
+    }
+
+    int i = ksym_find(frame->ip);
+    if (i >= 0) {
+        sym_samples[i]++;
+    } else {
+        unknown_samples++;
+    }
+}
+
+int profile_start(uint32_t hz) {
+    profile_stop();
+
+    if (!sym_samples) {
+        sym_samples = malloc(ksym_count * sizeof(uint32_t));
+        if (!sym_samples) {
+            return -1;
+        }
+    }
+
+    memset(sym_samples, 0, ksym_count * sizeof(uint32_t));
+    unknown_samples = 0;
+    idle_samples = 0;
+    total_samples = 0;
+
+    if (rtc_start_periodic(hz, &profile_sample, NULL) < 0) {
+        return -1;
+    }
+    running = true;
+
+    return 0;
+}
+
+void profile_stop(void) {
+    if (running) {
+        rtc_stop_periodic();
+        running = false;
+    }
+}
+
+void profile_dump(void) {
+    if (!sym_samples || total_samples == 0) {
+        printf("profile: no samples\n");
+        return;
+    }
+
+    uint32_t total = total_samples;
+    uint32_t busy = total - idle_samples;
+    printf("profile: %lu samples, busy %lu (%lu%%), idle %lu (%lu%%)\n", total,
+           busy, busy * 100 / total, idle_samples, idle_samples * 100 / total);
+
+    // repeatedly pick out the largest remaining entry, the table is small
+    int top[PROFILE_TOP_N];
+    int count = 0;
+    for (; count < PROFILE_TOP_N; count++) {
+        int best = -1;
+        for (size_t i = 0; i < ksym_count; i++) {
+            if (sym_samples[i] == 0) {
+                continue;
+            }
+            bool taken = false;
+            for (int j = 0; j < count; j++) {
+                if (top[j] == (int)i) {
+                    taken = true;
+                    break;
+                }
+            }
+            if (!taken && (best < 0 || sym_samples[i] > sym_samples[best])) {
+                best = i;
+            }
+        }
+        if (best < 0) {
+            break;
+        }
+        top[count] = best;
+    }
+
+    for (int i = 0; i < count; i++) {
+        uint32_t samples = sym_samples[top[i]];
+        printf("%8lu %3lu%% %s\n", samples, samples * 100 / total, ksym_table[top[i]].name);
+    }
+    if (unknown_samples) {
+        printf("%8lu %3lu%% <unknown>\n", unknown_samples, unknown_samples * 100 / total);
+    }
+}
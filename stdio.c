@@ -25,16 +25,22 @@
 #include <limits.h>
 #include <string.h>
 #include <console.h>
+#include <klog.h>
 
 int putchar(int _c) {
     char c = _c;
-    console_write(&c, 1, true);
+    klog_write(&c, 1);
     return c;
 }
 
 int puts(const char *c) {
-    console_write(c, (size_t)-1, true);
+    klog_write(c, strlen(c));
     putchar('\n');
     return 0;
 }
 
+int getchar(void) {
+    char c;
+    console_read(&c, 1);
+    return (unsigned char)c;
+}
@@ -25,7 +25,7 @@
 #include <stddef.h>
 #include <stdint.h>
 
-void *memcpy(void *dest, const void *src, size_t count) {
+static void *memcpy_movsb(void *dest, const void *src, size_t count) {
     void *olddest = dest;
     __asm__ volatile(
         "cld;"
@@ -36,6 +36,48 @@ void *memcpy(void *dest, const void *src, size_t count) {
     return olddest;
 }
 
+void *memcpy_movsl(void *dest, const void *src, size_t count) {
+    void *olddest = dest;
+    size_t tail = count & 3;
+    count >>= 2;
+    __asm__ volatile(
+        "cld;"
+        "rep movsl;"
+        "mov %3, %2;"
+        "rep movsb"
+        : "=D"(dest), "=S"(src), "=c"(count)
+        : "r"(tail), "0" (dest), "1" (src), "2" (count)
+        : "memory", "cc");
+    return olddest;
+}
+
+void *memcpy_unrolled(void *dest, const void *src, size_t count) {
+    uint32_t *d = dest;
+    const uint32_t *s = src;
+
+    // 32 bytes a pass, loads and stores in pairs so both pipes stay busy
+    for (; count >= 32; count -= 32, d += 8, s += 8) {
+        uint32_t a = s[0], b = s[1];
+        d[0] = a; d[1] = b;
+        a = s[2]; b = s[3];
+        d[2] = a; d[3] = b;
+        a = s[4]; b = s[5];
+        d[4] = a; d[5] = b;
+        a = s[6]; b = s[7];
+        d[6] = a; d[7] = b;
+    }
+
+    memcpy_movsl(d, s, count);
+    return dest;
+}
+
+// safe on anything, until x86_cpu_init() picks something faster
+void *(*memcpy_impl)(void *dest, const void *src, size_t count) = memcpy_movsb;
+
+void *memcpy(void *dest, const void *src, size_t count) {
+    return memcpy_impl(dest, src, count);
+}
+
 void *memset(void *dest, int c, size_t count) {
     void *olddest = dest;
     __asm__ volatile(
@@ -47,6 +89,19 @@ void *memset(void *dest, int c, size_t count) {
     return olddest;
 }
 
+int memcmp(const void *a, const void *b, size_t count) {
+    const unsigned char *p = a;
+    const unsigned char *q = b;
+
+    for (size_t i = 0; i < count; i++) {
+        if (p[i] != q[i]) {
+            return p[i] - q[i];
+        }
+    }
+
+    return 0;
+}
+
 size_t strlen(char const *s) {
     size_t i = 0;
 
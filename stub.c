@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2019 Travis Geiselbrecht
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <boot_image.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <compiler.h>
+#include <x86/x86.h>
+
+// the decompressor stub for compressed kernel images. it runs before anything
+// else is set up, so it only uses the PIT for timing and nothing from the kernel.
+
+// PIT channel 0 free running in mode 2 with a count of 65536, polled to measure
+// how long decompression takes
+static void pit_start(void) {
+    outp(0x43, 0x34);
+    outp(0x40, 0);
+    outp(0x40, 0);
+}
+
+static uint16_t pit_read(void) {
+    outp(0x43, 0);
+    uint16_t count = inp(0x40);
+    count |= inp(0x40) << 8;
+    return count;
+}
+
+// must be called more often than the counter wraps, every 55ms
+static void pit_poll(uint16_t *last, uint32_t *clocks) {
+    uint16_t now = pit_read();
+    *clocks += (uint16_t)(*last - now);
+    *last = now;
+}
+
+static size_t lzss_decompress(uint8_t *out, const uint8_t *in, size_t in_size, uint32_t *clocks) {
+    const uint8_t *in_end = in + in_size;
+    uint8_t *out_start = out;
+    uint16_t last = pit_read();
+    uint32_t group = 0;
+
+    while (in < in_end) {
+        uint8_t flags = *in++;
+
+        for (int bit = 0; bit < 8 && in < in_end; bit++, flags >>= 1) {
+            if (flags & 1) {
+                *out++ = *in++;
+            } else {
+                uint16_t v = in[0] | (in[1] << 8);
+                in += 2;
+
+                const uint8_t *src = out - (v & 0xfff) - 1;
+                size_t len = (v >> 12) + LZSS_MIN_MATCH;
+                while (len--) {
+                    *out++ = *src++;
+                }
+            }
+        }
+
+        // each group expands to at most 8 * LZSS_MAX_MATCH bytes
+        if ((++group & 0xff) == 0) {
+            pit_poll(&last, clocks);
+        }
+    }
+    pit_poll(&last, clocks);
+
+    return out - out_start;
+}
+
+__NO_RETURN void stub_main(uint32_t *boot_sp, const struct lzss_header *header);
+
+void stub_main(uint32_t *boot_sp, const struct lzss_header *header) {
+    uint8_t *kernel = (uint8_t *)KERNEL_LOAD_BASE;
+    uint32_t clocks = 0;
+
+    if (header->magic != BOOT_IMAGE_LZSS_MAGIC) {
+        for (;;) {
+            x86_hlt();
+        }
+    }
+
+    pit_start();
+    lzss_decompress(kernel, (const uint8_t *)(header + 1), header->compressed_size, &clocks);
+
+    struct boot_image_info *info = (struct boot_image_info *)(kernel + BOOT_IMAGE_INFO_OFFSET);
+    info->compressed_size = header->compressed_size;
+    info->uncompressed_size = header->uncompressed_size;
+    info->decompress_clocks = clocks;
+
+    // back onto the bootblock's stack and into the kernel, which finds its
+    // args exactly where it would have without the stub
+    __asm__ volatile(
+        "mov %0, %%esp;"
+        "jmp *%1"
+        :: "r"(boot_sp), "r"(kernel)
+        : "memory");
+    __UNREACHABLE;
+}
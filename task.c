@@ -23,6 +23,11 @@
 #include <task.h>
 
 #include <compiler.h>
+#include <irqsoff.h>
+#include <kcounter.h>
+#include <ktrace.h>
+#include <smp.h>
+#include <spinlock.h>
 #include <stdio.h>
 #include <string.h>
 #include <trace.h>
@@ -30,11 +35,28 @@
 
 #define LOCAL_TRACE 0
 
-static task_t idle_task;
+KCOUNTER(context_switches, "task.context_switch");
+KCOUNTER(preemptions, "task.preempt");
+KCOUNTER(steals, "task.steal");
+
+// cpu 0's idle stack, which start.S boots on
 uint8_t idle_stack[512] __ALIGNED(4);
 
-static task_t *current_task;
-static struct list_node run_queue;
+// the current task, idle task, run queue and need_resched flag are per cpu.
+// need_resched is set when a task has been made ready and the scheduler should
+// run at irq exit.
+static inline task_t *current_task(void) {
+    return percpu_get()->current_task;
+}
+
+// the kernel lock. it is held whenever the current task's critical section
+// count is above zero, so critical sections exclude each other across cpus as
+// well as irqs on the local one. a task switch hands it from the old task to
+// the new one.
+static spin_lock_t kernel_lock = SPIN_LOCK_INITIAL_VALUE;
+
+// new tasks are spread across the cpus in turn
+static uint32_t next_start_cpu;
 
 // called once at boot by the initial start routine to exit the single threaded phase
 // of bootup and start the scheduler.
@@ -51,15 +73,23 @@ void task_become_idle(void) {
     }
 }
 
+// make the code running on this cpu its idle task, inside a critical section
+void task_init_cpu(uintptr_t stack, size_t stack_size) {
+    struct percpu *cpu = percpu_get();
+
+    // create the idle task and set it as the current. it starts out inside a
+    // critical section, so it takes the lock to match.
+    task_create(&cpu->idle_task, "idle", NULL, 0, stack, stack_size);
+    cpu->idle_task.cpu = cpu->cpu_num;
+    cpu->current_task = &cpu->idle_task;
+    spin_lock(&kernel_lock);
+}
+
 // called once at startup to initialize the tasking subsystem
 void task_init(void) {
     LTRACEF("initializing tasks\n");
 
-    list_initialize(&run_queue);
-
-    // create the idle task and set it as the current
-    task_create(&idle_task, "idle", NULL, 0, (uintptr_t)idle_stack, sizeof(idle_stack));
-    current_task = &idle_task;
+    task_init_cpu((uintptr_t)idle_stack, sizeof(idle_stack));
 }
 
 // initial routine run by every new task
@@ -67,23 +97,23 @@ static void task_trampoline(void) {
     // reenable interrupts, since they were implicitly disabled by the reschedule routine
     exit_critical_section();
 
-    LTRACEF("top of task %p\n", current_task);
+    LTRACEF("top of task %p\n", current_task());
 
     // call the entry point
-    current_task->entry(current_task->arg);
+    current_task()->entry(current_task()->arg);
 
     // fall through to exit
     task_exit();
 }
 
 void task_exit(void) {
-    LTRACEF("exiting task %p\n", current_task);
+    LTRACEF("exiting task %p\n", current_task());
 
     enter_critical_section();
 
     // set ourselves to the DEAD state and reschedule
     // the scheduler wont put us back in the run queue
-    current_task->state = DEAD;
+    current_task()->state = DEAD;
     task_reschedule();
 
     // never get here
@@ -110,64 +140,211 @@ status_t task_create(task_t *t, const char *name, void (*entry)(void *), void *a
     return 0;
 }
 
-// move the task from the initial state and put it in the run queue
-status_t task_start(task_t *t) {
+// queue a ready task on a cpu and get that cpu to notice if it is idle.
+// the local cpu picks it up whenever it next reschedules.
+static void queue_task(task_t *t, uint32_t cpu_num, bool head) {
+    struct percpu *cpu = &percpu[cpu_num];
+
+    t->cpu = cpu_num;
+    if (head) {
+        list_add_head(&cpu->run_queue, &t->node);
+    } else {
+        list_add_tail(&cpu->run_queue, &t->node);
+    }
+
+    if (cpu_num != smp_cpu_num() && cpu->current_task == &cpu->idle_task) {
+        smp_reschedule(cpu_num);
+    }
+}
+
+// move the task from the initial state and put it in a cpu's run queue
+static status_t start_task(task_t *t, uint32_t cpu_num, bool pinned) {
     enter_critical_section();
 
-    if (t->state != INITIAL) {
+    if (t->state != INITIAL || cpu_num >= smp_cpu_count) {
         exit_critical_section();
         return -1;
     }
 
     t->state = READY;
-    list_add_head(&run_queue, &t->node);
+    t->pinned = pinned;
+    queue_task(t, cpu_num, true);
 
     exit_critical_section();
 
     return 0;
 }
 
+status_t task_start(task_t *t) {
+    enter_critical_section();
+    uint32_t cpu_num = next_start_cpu;
+    next_start_cpu = (next_start_cpu + 1) % smp_cpu_count;
+    status_t err = start_task(t, cpu_num, false);
+    exit_critical_section();
+
+    return err;
+}
+
+status_t task_start_on(task_t *t, uint32_t cpu_num) {
+    return start_task(t, cpu_num, true);
+}
+
+// take a task queued on another cpu, for when this one has nothing to do.
+// pinned tasks are left where they are.
+static task_t *steal_task(void) {
+    for (uint32_t i = 1; i < smp_cpu_count; i++) {
+        struct percpu *cpu = &percpu[(smp_cpu_num() + i) % smp_cpu_count];
+        task_t *t;
+        list_for_every_entry(&cpu->run_queue, t, task_t, node) {
+            if (!t->pinned) {
+                list_delete(&t->node);
+                kcounter_add(steals, 1);
+                return t;
+            }
+        }
+    }
+    return NULL;
+}
+
 // see if a new task is ready to run
 void task_reschedule(void) {
     enter_critical_section();
 
-    task_t *old_task = current_task;
+    struct percpu *cpu = percpu_get();
+    task_t *old_task = cpu->current_task;
     task_t *next_task;
 
     // if the old one is running, put it back in the run queue
-    if (current_task->state == RUNNING) {
-        current_task->state = READY;
-        list_add_tail(&run_queue, &current_task->node);
+    // the idle task is never queued, it is only picked when nothing else is ready
+    if (old_task->state == RUNNING && old_task != &cpu->idle_task) {
+        old_task->state = READY;
+        list_add_tail(&cpu->run_queue, &old_task->node);
     }
 
-    // find a new thread to run from the run queue
-    next_task = list_remove_head_type(&run_queue, struct task, node);
+    // find a new thread to run from the run queue, then from the other cpus'.
+    // the kernel lock is held until the switch is done, so a task queued
+    // above can't be picked up by another cpu while it is still on its stack.
+    next_task = list_remove_head_type(&cpu->run_queue, struct task, node);
+    if (!next_task) {
+        next_task = steal_task();
+    }
     if (!next_task) {
         // if nothing in the queue, pick the idle task
-        next_task = &idle_task;
+        next_task = &cpu->idle_task;
     }
 
     // mark the new task as running, even if it was the old one
-    current_task = next_task;
-    current_task->state = RUNNING;
+    cpu->current_task = next_task;
+    next_task->state = RUNNING;
+    next_task->cpu = cpu->cpu_num;
 
     // if the new task is actually different, do a low level stack swap
     if (next_task != old_task) {
+        KTRACE_INSTANT(context_switch, old_task, next_task);
+        kcounter_add(context_switches, 1);
         x86_task_switch(old_task, next_task);
     }
 
     exit_critical_section();
 }
 
+// irqs are already disabled here, bump the count directly so nothing in the
+// handler or the reschedule reenables them before the iret
+void task_irq_enter(void) {
+    if (current_task()->critical_section_count++ == 0) {
+        spin_lock(&kernel_lock);
+    }
+}
+
+void task_irq_exit(void) {
+    struct percpu *cpu = percpu_get();
+    if (cpu->need_resched) {
+        cpu->need_resched = false;
+        kcounter_add(preemptions, 1);
+        task_reschedule();
+    }
+
+    if (--current_task()->critical_section_count == 0) {
+        spin_unlock(&kernel_lock);
+    }
+}
+
+void task_set_need_resched(void) {
+    percpu_get()->need_resched = true;
+}
+
+task_t *task_get_current(void) {
+    return current_task();
+}
+
+bool task_is_idle(void) {
+    struct percpu *cpu = percpu_get();
+    return cpu->current_task == &cpu->idle_task;
+}
+
+// irqs go off before the count is touched, so an irq landing in the middle of
+// the update can't preempt the task with its count half changed
 void enter_critical_section(void) {
-    if (++current_task->critical_section_count == 1) {
-        x86_cli();
+    x86_cli();
+    if (++current_task()->critical_section_count == 1) {
+        spin_lock(&kernel_lock);
+        irqsoff_start(__GET_CALLER());
     }
 }
 
 void exit_critical_section(void) {
-    if (--current_task->critical_section_count == 0) {
+    if (--current_task()->critical_section_count == 0) {
+        irqsoff_stop(__GET_CALLER());
+        spin_unlock(&kernel_lock);
         x86_sti();
     }
 }
 
+void wait_queue_init(wait_queue_t *wq) {
+    list_initialize(&wq->list);
+}
+
+void wait_queue_block(wait_queue_t *wq) {
+    current_task()->state = BLOCKED;
+    list_add_tail(&wq->list, &current_task()->node);
+
+    task_reschedule();
+}
+
+// back onto the cpu it last ran on, whose scheduler then runs at its next irq exit
+static void wake_task(task_t *t) {
+    t->state = READY;
+    queue_task(t, t->cpu, false);
+    if (t->cpu == smp_cpu_num()) {
+        task_set_need_resched();
+    }
+}
+
+int wait_queue_wake_one(wait_queue_t *wq) {
+    enter_critical_section();
+
+    task_t *t = list_remove_head_type(&wq->list, task_t, node);
+    if (t) {
+        wake_task(t);
+    }
+
+    exit_critical_section();
+
+    return t ? 1 : 0;
+}
+
+int wait_queue_wake_all(wait_queue_t *wq) {
+    int count = 0;
+    task_t *t;
+
+    enter_critical_section();
+
+    while ((t = list_remove_head_type(&wq->list, task_t, node))) {
+        wake_task(t);
+        count++;
+    }
+
+    exit_critical_section();
+
+    return count;
+}
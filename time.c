@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 2019 Travis Geiselbrecht
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <time.h>
+
+#include <spinlock.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <hw/pit.h>
+#include <x86/cpu.h>
+#include <x86/x86.h>
+
+// nanosecond clock, driven by the TSC when the cpu has one and by the PIT otherwise.
+// conversions are done as (clocks * mult) >> shift to avoid 64 bit divides.
+
+// ns per PIT clock (838.095...) in 10.22 fixed point
+#define PIT_NS_SHIFT    22
+#define PIT_NS_MULT     3515225674U // 1000000000 << 22 / PIT_FREQ
+
+// ns per TSC cycle in 8.24 fixed point, good down to a 4MHz cpu
+#define TSC_NS_SHIFT    24
+
+static uint32_t tsc_ns_mult;
+static uint64_t tsc_base;
+static uint64_t tsc_base_ns;
+
+// last value returned by the PIT path, to paper over the rare undercount in pit_read_clocks().
+// the lock keeps it monotonic with several cpus reading at once.
+static spin_lock_t pit_time_lock = SPIN_LOCK_INITIAL_VALUE;
+static uint64_t last_pit_ns;
+
+// a 64x32 multiply returning bits [shift, shift + 64) of the 96 bit product
+static inline uint64_t mul_u64_u32_shr(uint64_t a, uint32_t mult, unsigned int shift) {
+    uint32_t hi = a >> 32;
+    uint32_t lo = a;
+
+    uint64_t ret = ((uint64_t)lo * mult) >> shift;
+    if (hi) {
+        ret += ((uint64_t)hi * mult) << (32 - shift);
+    }
+    return ret;
+}
+
+static uint64_t pit_time_ns(void) {
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&pit_time_lock, &state);
+
+    uint64_t ns = mul_u64_u32_shr(pit_read_clocks(), PIT_NS_MULT, PIT_NS_SHIFT);
+    if (ns < last_pit_ns) {
+        ns = last_pit_ns;
+    }
+    last_pit_ns = ns;
+
+    spin_unlock_irqrestore(&pit_time_lock, state);
+
+    return ns;
+}
+
+static uint64_t tsc_time_ns(void) {
+    return tsc_base_ns + mul_u64_u32_shr(x86_rdtsc() - tsc_base, tsc_ns_mult, TSC_NS_SHIFT);
+}
+
+// switched to tsc_time_ns once the TSC is calibrated
+static uint64_t (*time_source_ns)(void) = pit_time_ns;
+
+uint64_t current_time_ns(void) {
+    return time_source_ns();
+}
+
+// interpolated like the ns clock, so one shot timers can be armed to the ms
+// rather than to the next PIT tick. early log messages read it before the PIT
+// is counting.
+uint32_t current_time(void) {
+    if (!pit_is_running()) {
+        return 0;
+    }
+    return current_time_ns() / 1000000;
+}
+
+// count TSC cycles across roughly half a PIT period and derive the ns per cycle
+static void tsc_calibrate(void) {
+    x86_flags_t flags = x86_irq_disable();
+
+    uint64_t clocks_start = pit_read_clocks();
+    uint64_t tsc_start = x86_rdtsc();
+
+    uint64_t clocks_end;
+    do {
+        clocks_end = pit_read_clocks();
+    } while (clocks_end - clocks_start < pit_get_countdown() / 2u);
+
+    uint64_t tsc_end = x86_rdtsc();
+
+    x86_irq_restore(flags);
+
+    uint32_t ns = mul_u64_u32_shr(clocks_end - clocks_start, PIT_NS_MULT, PIT_NS_SHIFT);
+    uint64_t cycles = tsc_end - tsc_start;
+    if (cycles == 0) {
+        return;
+    }
+
+    uint64_t mult = ((uint64_t)ns << TSC_NS_SHIFT) / cycles;
+    if (mult == 0 || mult > UINT32_MAX) {
+        return;
+    }
+
+    // continue from wherever the PIT clock is now so time stays monotonic across the switch
+    tsc_ns_mult = mult;
+    tsc_base_ns = pit_time_ns();
+    tsc_base = x86_rdtsc();
+    time_source_ns = tsc_time_ns;
+
+    printf("time: using TSC at %lu kHz\n", (uint32_t)(cycles * 1000000 / ns));
+}
+
+void time_init(void) {
+    if (x86_feature_test(X86_FEATURE_TSC)) {
+        tsc_calibrate();
+    }
+
+    if (time_source_ns != tsc_time_ns) {
+        printf("time: using PIT\n");
+    }
+}
@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2019 Travis Geiselbrecht
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <timer.h>
+
+#include <compiler.h>
+#include <task.h>
+#include <hw/lapic.h>
+#include <time.h>
+#include <trace.h>
+#include <x86/x86.h>
+
+#define LOCAL_TRACE 0
+
+// pending timers, sorted by scheduled time. timer_tick() runs from the timer
+// irq, which holds the kernel lock, so the rest take it with a critical section.
+static struct list_node timer_queue = LIST_INITIAL_VALUE(timer_queue);
+
+void timer_initialize(timer_t *t) {
+    *t = (timer_t)TIMER_INITIAL_VALUE(*t);
+}
+
+void timer_set_oneshot(timer_t *t, uint32_t delay, timer_callback callback, void *arg) {
+    LTRACEF("t %p delay %lu callback %p arg %p\n", t, delay, callback, arg);
+
+    enter_critical_section();
+
+    if (list_in_list(&t->node)) {
+        list_delete(&t->node);
+    }
+
+    t->scheduled_time = current_time() + delay;
+    t->callback = callback;
+    t->arg = arg;
+
+    // insert in front of the first timer that expires later, so timers
+    // with the same deadline fire in the order they were set
+    timer_t *entry;
+    list_for_every_entry(&timer_queue, entry, timer_t, node) {
+        if ((int32_t)(entry->scheduled_time - t->scheduled_time) > 0) {
+            list_add_before(&entry->node, &t->node);
+            goto done;
+        }
+    }
+    list_add_tail(&timer_queue, &t->node);
+
+done:
+    // a one shot tick source has to be pulled in for a new earliest timer
+    if (list_peek_head(&timer_queue) == &t->node) {
+        lapic_timer_set_deadline(t->scheduled_time);
+    }
+
+    exit_critical_section();
+}
+
+void timer_cancel(timer_t *t) {
+    enter_critical_section();
+
+    if (list_in_list(&t->node)) {
+        list_delete(&t->node);
+    }
+
+    exit_critical_section();
+}
+
+void timer_tick(uint32_t now) {
+    timer_t *t;
+
+    while ((t = list_peek_head_type(&timer_queue, timer_t, node))) {
+        if ((int32_t)(now - t->scheduled_time) < 0) {
+            break;
+        }
+
+        list_delete(&t->node);
+        t->callback(t, now, t->arg);
+    }
+}
+
+bool timer_get_deadline(uint32_t *deadline) {
+    timer_t *t = list_peek_head_type(&timer_queue, timer_t, node);
+    if (!t) {
+        return false;
+    }
+
+    *deadline = t->scheduled_time;
+    return true;
+}
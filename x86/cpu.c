@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2019 Travis Geiselbrecht
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <x86/cpu.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <x86/x86.h>
+
+uint32_t x86_features;
+uint32_t x86_family;
+
+static char vendor[13];
+
+static void tlb_flush_page_cr3(uintptr_t va) {
+    x86_tlb_flush_all();
+}
+
+static void tlb_flush_page_invlpg(uintptr_t va) {
+    __asm__ volatile("invlpg (%0)" :: "r"(va) : "memory");
+}
+
+void (*x86_tlb_flush_page)(uintptr_t va) = tlb_flush_page_cr3;
+
+// the AC bit in EFLAGS only exists on a 486 and up
+#define X86_FLAGS_AC (1 << 18)
+
+static bool flags_bit_toggles(x86_flags_t bit) {
+    x86_flags_t flags = x86_save_flags();
+    x86_restore_flags(flags ^ bit);
+    x86_flags_t toggled = x86_save_flags();
+    x86_restore_flags(flags);
+
+    return ((flags ^ toggled) & bit) != 0;
+}
+
+static void detect(void) {
+    x86_family = 3;
+    if (!flags_bit_toggles(X86_FLAGS_AC)) {
+        return;
+    }
+
+    x86_family = 4;
+    x86_features |= X86_FEATURE_486;
+    if (!x86_has_cpuid()) {
+        return;
+    }
+
+    x86_features |= X86_FEATURE_CPUID;
+
+    uint32_t max_leaf, b, c, d;
+    x86_cpuid(0, &max_leaf, &b, &c, &d);
+    memcpy(&vendor[0], &b, 4);
+    memcpy(&vendor[4], &d, 4);
+    memcpy(&vendor[8], &c, 4);
+    if (max_leaf < 1) {
+        return;
+    }
+
+    uint32_t a;
+    x86_cpuid(1, &a, &b, &c, &d);
+    x86_family = (a >> 8) & 0xf;
+    if (x86_family == 0xf) {
+        x86_family += (a >> 20) & 0xff;
+    }
+
+    static const struct {
+        uint32_t edx_bit;
+        uint32_t feature;
+    } edx_features[] = {
+        { 1 << 0, X86_FEATURE_FPU },
+        { 1 << 4, X86_FEATURE_TSC },
+        { 1 << 8, X86_FEATURE_CX8 },
+        { 1 << 9, X86_FEATURE_APIC },
+        { 1 << 15, X86_FEATURE_CMOV },
+        { 1 << 23, X86_FEATURE_MMX },
+    };
+    for (size_t i = 0; i < countof(edx_features); i++) {
+        if (d & edx_features[i].edx_bit) {
+            x86_features |= edx_features[i].feature;
+        }
+    }
+}
+
+void x86_cpu_init(void) {
+    detect();
+
+    if (x86_feature_test(X86_FEATURE_486)) {
+        x86_tlb_flush_page = tlb_flush_page_invlpg;
+    }
+
+    // the pentium moves dwords fastest as pairs of plain loads and stores,
+    // everything else with a string move
+    memcpy_impl = (x86_family == 5) ? memcpy_unrolled : memcpy_movsl;
+}
+
+void x86_cpu_dump(void) {
+    static const char *const names[] = {
+        "486", "cpuid", "fpu", "tsc", "cx8", "apic", "cmov", "mmx",
+    };
+
+    printf("cpu: family %lu", x86_family);
+    if (vendor[0]) {
+        printf(" %s", vendor);
+    }
+    printf(", features");
+    for (size_t i = 0; i < countof(names); i++) {
+        if (x86_features & (1U << i)) {
+            printf(" %s", names[i]);
+        }
+    }
+    printf("\n");
+}
@@ -0,0 +1,347 @@
+/*
+ * Copyright (c) 2019 Travis Geiselbrecht
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <x86/mp.h>
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+struct mp_config mp_config;
+
+// the tables are found by scanning the first KB of the extended bios data
+// area, then the bios rom, on 16 byte boundaries
+#define BDA_EBDA_SEG    0x40e
+#define BIOS_ROM_START  0xe0000
+#define BIOS_ROM_END    0x100000
+
+static bool checksum_ok(const void *ptr, size_t len) {
+    const uint8_t *p = ptr;
+    uint8_t sum = 0;
+    for (size_t i = 0; i < len; i++) {
+        sum += p[i];
+    }
+    return sum == 0;
+}
+
+static const void *scan_range(uintptr_t start, uintptr_t end, const char *sig, size_t sig_len, size_t len) {
+    for (uintptr_t p = start; p + len <= end; p += 16) {
+        if (memcmp((const void *)p, sig, sig_len) == 0 && checksum_ok((const void *)p, len)) {
+            return (const void *)p;
+        }
+    }
+    return NULL;
+}
+
+static const void *scan(const char *sig, size_t sig_len, size_t len) {
+    // read the segment with a plain load, the compiler objects to dereferencing
+    // a constant address this low
+    uint16_t ebda_seg;
+    __asm__ volatile("movw %c1, %0" : "=r" (ebda_seg) : "i" (BDA_EBDA_SEG));
+
+    const void *p = NULL;
+    if (ebda_seg) {
+        uintptr_t ebda = (uintptr_t)ebda_seg << 4;
+        p = scan_range(ebda, ebda + 1024, sig, sig_len, len);
+    }
+    if (!p) {
+        p = scan_range(BIOS_ROM_START, BIOS_ROM_END, sig, sig_len, len);
+    }
+    return p;
+}
+
+static void add_cpu(uint8_t apic_id) {
+    if (mp_config.cpu_count < SMP_MAX_CPUS) {
+        mp_config.apic_ids[mp_config.cpu_count++] = apic_id;
+    }
+}
+
+static void set_ioapic(uint8_t id, uintptr_t addr, uint32_t gsi_base) {
+    if (!mp_config.ioapic_addr) {
+        mp_config.ioapic_id = id;
+        mp_config.ioapic_addr = addr;
+        mp_config.ioapic_gsi_base = gsi_base;
+    }
+}
+
+// ACPI
+
+struct acpi_rsdp {
+    char sig[8];
+    uint8_t checksum;
+    char oem_id[6];
+    uint8_t revision;
+    uint32_t rsdt_addr;
+} __PACKED;
+
+struct acpi_header {
+    char sig[4];
+    uint32_t len;
+    uint8_t revision;
+    uint8_t checksum;
+    char oem_id[6];
+    char oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+} __PACKED;
+
+struct acpi_madt {
+    struct acpi_header hdr;
+    uint32_t lapic_addr;
+    uint32_t flags;
+} __PACKED;
+
+#define MADT_LAPIC          0
+#define MADT_IOAPIC         1
+#define MADT_ISO            2   // interrupt source override
+
+#define MADT_LAPIC_ENABLED  (1 << 0)
+
+struct madt_entry {
+    uint8_t type;
+    uint8_t len;
+    union {
+        struct {
+            uint8_t acpi_id;
+            uint8_t apic_id;
+            uint32_t flags;
+        } __PACKED lapic;
+        struct {
+            uint8_t id;
+            uint8_t reserved;
+            uint32_t addr;
+            uint32_t gsi_base;
+        } __PACKED ioapic;
+        struct {
+            uint8_t bus;
+            uint8_t source;
+            uint32_t gsi;
+            uint16_t flags;
+        } __PACKED iso;
+    };
+} __PACKED;
+
+static const struct acpi_madt *acpi_find_madt(void) {
+    const struct acpi_rsdp *rsdp = scan("RSD PTR ", 8, sizeof(struct acpi_rsdp));
+    if (!rsdp) {
+        return NULL;
+    }
+
+    const struct acpi_header *rsdt = (const void *)rsdp->rsdt_addr;
+    if (memcmp(rsdt->sig, "RSDT", 4) != 0 || !checksum_ok(rsdt, rsdt->len)) {
+        return NULL;
+    }
+
+    const uint32_t *tables = (const void *)(rsdt + 1);
+    size_t count = (rsdt->len - sizeof(*rsdt)) / 4;
+    for (size_t i = 0; i < count; i++) {
+        const struct acpi_header *hdr = (const void *)tables[i];
+        if (memcmp(hdr->sig, "APIC", 4) == 0 && checksum_ok(hdr, hdr->len)) {
+            return (const void *)hdr;
+        }
+    }
+    return NULL;
+}
+
+static bool acpi_parse(void) {
+    const struct acpi_madt *madt = acpi_find_madt();
+    if (!madt) {
+        return false;
+    }
+
+    mp_config.source = "ACPI";
+    mp_config.lapic_addr = madt->lapic_addr;
+
+    uintptr_t pos = (uintptr_t)(madt + 1);
+    uintptr_t end = (uintptr_t)madt + madt->hdr.len;
+    while (pos + 2 <= end) {
+        const struct madt_entry *e = (const void *)pos;
+        if (e->len < 2) {
+            break;
+        }
+
+        switch (e->type) {
+            case MADT_LAPIC:
+                if (e->lapic.flags & MADT_LAPIC_ENABLED) {
+                    add_cpu(e->lapic.apic_id);
+                }
+                break;
+            case MADT_IOAPIC:
+                set_ioapic(e->ioapic.id, e->ioapic.addr, e->ioapic.gsi_base);
+                break;
+            case MADT_ISO:
+                if (e->iso.bus == 0 && e->iso.source < 16) {
+                    mp_config.isa_irq[e->iso.source].gsi = e->iso.gsi;
+                    mp_config.isa_irq[e->iso.source].flags = e->iso.flags;
+                }
+                break;
+        }
+        pos += e->len;
+    }
+
+    return true;
+}
+
+// MP specification 1.4
+
+struct mp_floating {
+    char sig[4];
+    uint32_t config_addr;
+    uint8_t len;                // in 16 byte units
+    uint8_t spec_rev;
+    uint8_t checksum;
+    uint8_t features[5];
+} __PACKED;
+
+#define MP_FEATURE2_IMCR    (1 << 7)
+
+struct mp_config_header {
+    char sig[4];
+    uint16_t len;
+    uint8_t spec_rev;
+    uint8_t checksum;
+    char oem_id[8];
+    char product_id[12];
+    uint32_t oem_table;
+    uint16_t oem_table_len;
+    uint16_t entry_count;
+    uint32_t lapic_addr;
+    uint16_t ext_len;
+    uint8_t ext_checksum;
+    uint8_t reserved;
+} __PACKED;
+
+#define MP_ENTRY_CPU        0
+#define MP_ENTRY_BUS        1
+#define MP_ENTRY_IOAPIC     2
+#define MP_ENTRY_IOINT      3
+
+#define MP_CPU_ENABLED      (1 << 0)
+#define MP_IOAPIC_ENABLED   (1 << 0)
+#define MP_IOINT_INT        0   // a vectored interrupt, rather than nmi, smi or extint
+
+struct mp_entry {
+    uint8_t type;
+    union {
+        struct {
+            uint8_t apic_id;
+            uint8_t apic_version;
+            uint8_t flags;
+            uint32_t signature;
+            uint32_t features;
+            uint32_t reserved[2];
+        } __PACKED cpu;
+        struct {
+            uint8_t id;
+            char type[6];
+        } __PACKED bus;
+        struct {
+            uint8_t id;
+            uint8_t version;
+            uint8_t flags;
+            uint32_t addr;
+        } __PACKED ioapic;
+        struct {
+            uint8_t int_type;
+            uint16_t flags;
+            uint8_t src_bus;
+            uint8_t src_irq;
+            uint8_t dst_apic;
+            uint8_t dst_intin;
+        } __PACKED ioint;
+    };
+} __PACKED;
+
+static bool mp_parse(void) {
+    const struct mp_floating *fp = scan("_MP_", 4, sizeof(struct mp_floating));
+    if (!fp || !fp->config_addr) {
+        // no table, or one of the default configurations, which this doesn't handle
+        return false;
+    }
+
+    const struct mp_config_header *hdr = (const void *)fp->config_addr;
+    if (memcmp(hdr->sig, "PCMP", 4) != 0 || !checksum_ok(hdr, hdr->len)) {
+        return false;
+    }
+
+    mp_config.source = "MP";
+    mp_config.lapic_addr = hdr->lapic_addr;
+    mp_config.imcr = (fp->features[1] & MP_FEATURE2_IMCR) != 0;
+
+    // which bus ids are isa, for the interrupt entries that follow
+    uint32_t isa_buses = 0;
+
+    uintptr_t pos = (uintptr_t)(hdr + 1);
+    for (uint16_t i = 0; i < hdr->entry_count; i++) {
+        const struct mp_entry *e = (const void *)pos;
+        switch (e->type) {
+            case MP_ENTRY_CPU:
+                if (e->cpu.flags & MP_CPU_ENABLED) {
+                    add_cpu(e->cpu.apic_id);
+                }
+                pos += 20;
+                break;
+            case MP_ENTRY_BUS:
+                if (e->bus.id < 32 && memcmp(e->bus.type, "ISA", 3) == 0) {
+                    isa_buses |= 1U << e->bus.id;
+                }
+                pos += 8;
+                break;
+            case MP_ENTRY_IOAPIC:
+                if (e->ioapic.flags & MP_IOAPIC_ENABLED) {
+                    set_ioapic(e->ioapic.id, e->ioapic.addr, 0);
+                }
+                pos += 8;
+                break;
+            case MP_ENTRY_IOINT:
+                if (e->ioint.int_type == MP_IOINT_INT && e->ioint.src_bus < 32 &&
+                        (isa_buses & (1U << e->ioint.src_bus)) && e->ioint.src_irq < 16 &&
+                        e->ioint.dst_apic == mp_config.ioapic_id) {
+                    mp_config.isa_irq[e->ioint.src_irq].gsi = e->ioint.dst_intin;
+                    mp_config.isa_irq[e->ioint.src_irq].flags = e->ioint.flags;
+                }
+                pos += 8;
+                break;
+            default:
+                pos += 8;
+                break;
+        }
+    }
+
+    return true;
+}
+
+bool mp_init(void) {
+    for (int i = 0; i < 16; i++) {
+        mp_config.isa_irq[i].gsi = i;
+        mp_config.isa_irq[i].flags = 0;
+    }
+
+    if (!acpi_parse() && !mp_parse()) {
+        return false;
+    }
+
+    printf("mp: %s tables, %lu cpus, lapic %#lx, ioapic %#lx\n", mp_config.source,
+           mp_config.cpu_count, mp_config.lapic_addr, mp_config.ioapic_addr);
+    return true;
+}
@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) 2019 Travis Geiselbrecht
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files
+ * (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify, merge,
+ * publish, distribute, sublicense, and/or sell copies of the Software,
+ * and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <smp.h>
+
+#include <atomic.h>
+#include <delay.h>
+#include <stdio.h>
+#include <string.h>
+#include <hw/lapic.h>
+#include <hw/pic.h>
+#include <x86/cpu.h>
+#include <x86/mp.h>
+
+struct percpu percpu[SMP_MAX_CPUS];
+uint32_t smp_cpu_count = 1;
+
+// idle stacks for the application processors, cpu 0 boots on idle_stack
+static uint8_t ap_idle_stacks[SMP_MAX_CPUS][1024] __ALIGNED(4);
+
+// handed to the cpu being started, one at a time
+uintptr_t smp_ap_stack;
+static uint32_t ap_cpu_num;
+
+// startup handshake. the cpu checks in and then waits to be released, so one
+// that misses the timeout can be put back in reset before it has touched
+// anything shared.
+enum {
+    AP_STATE_STARTING,
+    AP_STATE_STARTED,
+    AP_STATE_RELEASED,
+};
+static uint32_t ap_state;
+
+// in smp_trampoline.S
+extern const uint8_t smp_trampoline[];
+extern const uint8_t smp_trampoline_end[];
+
+void percpu_init(uint32_t cpu_num) {
+    struct percpu *cpu = &percpu[cpu_num];
+
+    cpu->self = cpu;
+    cpu->cpu_num = cpu_num;
+    list_initialize(&cpu->run_queue);
+
+    // a byte granular 32bit data segment covering just this entry
+    uint16_t sel = X86_PERCPU_SELECTOR(cpu_num);
+    x86_set_gdt_entry(sel, (uintptr_t)cpu, sizeof(*cpu) - 1, 0b10010010, 0b01000000);
+    __asm__ volatile("mov %0, %%fs" :: "r"(sel) : "memory");
+
+    x86_tss_init(&cpu->tss, cpu_num);
+}
+
+void smp_reschedule(uint32_t cpu_num) {
+    if (cpu_num == smp_cpu_num()) {
+        task_set_need_resched();
+    } else {
+        lapic_send_ipi(percpu[cpu_num].apic_id, LAPIC_VECTOR_RESCHEDULE);
+    }
+}
+
+// application processors come here from smp_trampoline.S
+void smp_ap_main(void) {
+    uint32_t cpu_num = ap_cpu_num;
+
+    x86_init_cpu(cpu_num);
+    lapic_init(false);
+
+    // let smp_init() move on before waiting on the kernel lock, which the
+    // boot cpu holds until it goes idle
+    atomic_store(&ap_state, AP_STATE_STARTED);
+    while (atomic_load(&ap_state) != AP_STATE_RELEASED) {
+        arch_spin_pause();
+    }
+
+    task_init_cpu((uintptr_t)ap_idle_stacks[cpu_num], sizeof(ap_idle_stacks[cpu_num]));
+    lapic_timer_init();
+    task_become_idle();
+}
+
+void smp_init(void) {
+    if (!mp_init() || !x86_feature_test(X86_FEATURE_APIC)) {
+        return;
+    }
+
+    lapic_set_base(mp_config.lapic_addr);
+    lapic_init(true);
+    percpu[0].apic_id = lapic_get_id();
+
+    // move the irqs and the timer over to the apics, the other cpus reuse
+    // the calibration done here
+    pic_switch_to_ioapic();
+    lapic_timer_init();
+
+    if (mp_config.cpu_count < 2) {
+        return;
+    }
+
+    memcpy((void *)SMP_TRAMPOLINE_BASE, smp_trampoline, smp_trampoline_end - smp_trampoline);
+
+    for (uint32_t i = 0; i < mp_config.cpu_count && smp_cpu_count < SMP_MAX_CPUS; i++) {
+        uint32_t apic_id = mp_config.apic_ids[i];
+        if (apic_id == percpu[0].apic_id) {
+            continue;
+        }
+
+        uint32_t cpu_num = smp_cpu_count;
+        percpu[cpu_num].apic_id = apic_id;
+        smp_ap_stack = (uintptr_t)ap_idle_stacks[cpu_num] + sizeof(ap_idle_stacks[cpu_num]);
+        ap_cpu_num = cpu_num;
+        atomic_store(&ap_state, AP_STATE_STARTING);
+
+        lapic_start_ap(apic_id, SMP_TRAMPOLINE_BASE);
+        if (!spin_until(atomic_load(&ap_state) == AP_STATE_STARTED, 100000)) {
+            // hold it in reset, so it can't wake up later and pick up the
+            // cpu number and stack handed to the next one. if it checked in
+            // just now it is still waiting to be released, and stops there.
+            lapic_stop_ap(apic_id);
+            printf("smp: cpu with apic id %lu did not start\n", apic_id);
+            continue;
+        }
+        atomic_store(&ap_state, AP_STATE_RELEASED);
+
+        // only now can tasks be placed on it
+        smp_cpu_count++;
+    }
+
+    printf("smp: %lu cpus running\n", smp_cpu_count);
+}
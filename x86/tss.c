@@ -26,18 +26,13 @@
 #include <string.h>
 #include <task.h>
 
-static struct x86_tss kernel_tss;
+// initialize a cpu's tss and switch to it, only ring 0 runs so it holds nothing
+void x86_tss_init(struct x86_tss *tss, uint32_t cpu_num) {
+    uint16_t sel = X86_TSS_SELECTOR(cpu_num);
 
-void x86_tss_init(void) {
-    // initialize the kernel tss and switch to it
+    // punch in the address of the tss, present 32bit available tss
+    x86_set_gdt_entry(sel, (uintptr_t)tss, sizeof(*tss) - 1, 0b10001001, 0);
 
-    // punch in the address of the kernel_tss
-    struct x86_desc_32 *kernel_tss_gdt = &gdt[KERNEL_TSS_SELECTOR / 8];
-    kernel_tss_gdt->seg_limit_15_0 = sizeof(kernel_tss) - 1;
-    kernel_tss_gdt->base_15_0 = ((uintptr_t)&kernel_tss) & 0xffff;
-    kernel_tss_gdt->base_23_16 = (((uintptr_t)&kernel_tss) >> 16) & 0xff;
-    kernel_tss_gdt->base_31_24 = (((uintptr_t)&kernel_tss) >> 24) & 0xff;
-
-    // use ltr to load the kernel task register
-    __asm__ volatile("ltr %0" :: "r"((uint16_t)KERNEL_TSS_SELECTOR) : "memory");
+    // use ltr to load the task register
+    __asm__ volatile("ltr %0" :: "r"(sel) : "memory");
 }
@@ -23,8 +23,13 @@
 #include <x86/x86.h>
 
 #include <compiler.h>
+#include <x86/cpu.h>
+#include <klog.h>
+#include <smp.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <task.h>
+#include <hw/lapic.h>
 #include <hw/pic.h>
 
 struct x86_desc_32 gdt[GDT_COUNT] = {
@@ -74,6 +79,8 @@ struct x86_desc_32 gdt[GDT_COUNT] = {
         0b10000000,       // G(1) 0 0 0 limit 19:16
         0x0               // base 31:24
     },
+    // the other cpus' tss descriptors and every cpu's percpu data segment
+    // are filled in by x86_set_gdt_entry() as each cpu comes up
 };
 
 static struct x86_gate_desc_32 idt[NUM_INT];
@@ -83,8 +90,18 @@ extern void x86_exception_entry(void);
 extern void x86_irq_entry(void);
 extern void _isr_table(void);
 
-// early cpu initialization
-void x86_init(void) {
+void x86_set_gdt_entry(uint16_t sel, uintptr_t base, uint32_t limit, uint8_t access, uint8_t flags) {
+    struct x86_desc_32 *desc = &gdt[sel / 8];
+    desc->seg_limit_15_0 = limit & 0xffff;
+    desc->base_15_0 = base & 0xffff;
+    desc->base_23_16 = (base >> 16) & 0xff;
+    desc->p_dpl_s_type = access;
+    desc->g_db_seg_limit_19_16 = flags | ((limit >> 16) & 0xf);
+    desc->base_31_24 = (base >> 24) & 0xff;
+}
+
+// the per cpu half of x86_init(), run on each cpu once the shared tables exist
+void x86_init_cpu(uint32_t cpu_num) {
     // switch to our GDT
     struct x86_desc_ptr gdt_ptr;
     gdt_ptr.len = sizeof(gdt) - 1;
@@ -92,10 +109,10 @@ void x86_init(void) {
     __asm__ volatile("lgdt %0" :: "m"(gdt_ptr) : "memory");
 
     // reload our segments
+    // fs is loaded with this cpu's percpu segment below
     __asm__ volatile(
         "mov  %0, %%ds;"
         "mov  %0, %%es;"
-        "mov  %0, %%fs;"
         "mov  %0, %%gs;"
         "mov  %0, %%ss;"
         :: "r"(DATA_SELECTOR)
@@ -107,6 +124,20 @@ void x86_init(void) {
         "0:;"
         :: "i"(CODE_SELECTOR));
 
+    // load the IDT
+    struct x86_desc_ptr idt_ptr;
+    idt_ptr.len = sizeof(idt) - 1;
+    idt_ptr.ptr = (uint32_t)idt;
+    __asm__ volatile("lidt %0" :: "m"(idt_ptr) : "memory");
+
+    // set up fs and switch to this cpu's tss
+    percpu_init(cpu_num);
+}
+
+// early cpu initialization
+void x86_init(void) {
+    x86_cpu_init();
+
     // initialize the idt
     uintptr_t target = (uintptr_t)_isr_table;
     for (int i = 0; i < NUM_INT; i++) {
@@ -122,14 +153,7 @@ void x86_init(void) {
         target += 16;
     }
 
-    // load the IDT
-    struct x86_desc_ptr idt_ptr;
-    idt_ptr.len = sizeof(idt) - 1;
-    idt_ptr.ptr = (uint32_t)idt;
-    __asm__ volatile("lidt %0" :: "m"(idt_ptr) : "memory");
-
-    // switch to the kernel tss
-    x86_tss_init();
+    x86_init_cpu(0);
 }
 
 static void dump_fault_frame(struct x86_iframe *frame) {
@@ -145,6 +169,8 @@ static void dump_fault_frame(struct x86_iframe *frame) {
 
 __NO_RETURN
 static void exception_die(struct x86_iframe *frame, const char *msg) {
+    klog_panic();
+
     printf(msg);
     dump_fault_frame(frame);
 
@@ -154,11 +180,27 @@ static void exception_die(struct x86_iframe *frame, const char *msg) {
     }
 }
 
+struct x86_iframe *x86_get_irq_frame(void) {
+    return percpu_get()->irq_frame;
+}
+
 __FASTCALL void x86_exception_handler(struct x86_iframe *iframe) {
+    struct percpu *cpu = percpu_get();
 
     switch (iframe->vector) {
         case 0x20 ... 0x2f: // PIC interrupts
+            task_irq_enter();
+            cpu->irq_frame = iframe;
             pic_irq(iframe->vector - 0x20);
+            cpu->irq_frame = NULL;
+            task_irq_exit();
+            break;
+        case LAPIC_VECTOR_BASE ... LAPIC_VECTOR_END - 1: // local apic interrupts
+            task_irq_enter();
+            cpu->irq_frame = iframe;
+            lapic_irq(iframe->vector);
+            cpu->irq_frame = NULL;
+            task_irq_exit();
             break;
         default:
             printf("vector %lu (%#lx), err code %#lx\n", iframe->vector, iframe->vector, iframe->err_code);